@@ -0,0 +1,380 @@
+#include <pch.hpp>
+
+#include <iomanip>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <app.hpp>
+#include <util.hpp>
+#include <config.hpp>
+#include <loop.hpp>
+#include <scheduler.hpp>
+#include <scrape.hpp>
+#include <loader.hpp>
+#include <deletion.hpp>
+#include <logger.hpp>
+#include <profile.hpp>
+
+#include <tracker.hpp>
+#include <synthetic.hpp>
+
+extern char **environ;
+
+struct sample {
+	std::chrono::steady_clock::time_point time;
+	uint64_t rss; // Resident set size in KiB
+	uint64_t syscr; // Calls of read-like syscalls, as counted in /proc/self/io. Other syscalls like stat, mmap or rename are not counted.
+	uint64_t syscw; // Calls of write-like syscalls
+};
+
+// Returns the number following key on the first line of the file that starts with it, or 0 if there is none
+static uint64_t read_proc_value(const char *path, const std::string &key) {
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.starts_with(key))
+			return std::stoull(line.substr(key.size()));
+	}
+	return 0;
+}
+
+static sample take_sample() {
+	return {
+		std::chrono::steady_clock::now(),
+		read_proc_value("/proc/self/status", "VmRSS:"),
+		read_proc_value("/proc/self/io", "syscr:"),
+		read_proc_value("/proc/self/io", "syscw:")
+	};
+}
+
+static void print_header(std::ostream &report) {
+	report << std::left << std::setw(10) << "phase" << std::right
+			<< std::setw(10) << "torrents"
+			<< std::setw(12) << "total ms"
+			<< std::setw(8) << "cycles"
+			<< std::setw(12) << "ms/cycle"
+			<< std::setw(10) << "RSS MiB"
+			<< std::setw(12) << "read calls"
+			<< std::setw(13) << "write calls"
+			<< "  note" << std::endl;
+}
+
+static void print_result(std::ostream &report, const std::string &phase, uint32_t count, const sample &before, const sample &after, uint32_t cycles, const std::string &note = "") {
+	double milliseconds = std::chrono::duration<double, std::milli>(after.time - before.time).count();
+
+	report << std::left << std::setw(10) << phase << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << count
+			<< std::setw(12) << milliseconds
+			<< std::setw(8) << cycles
+			<< std::setw(12) << (cycles ? milliseconds / cycles : milliseconds)
+			<< std::setw(10) << after.rss / 1024.0
+			<< std::setw(12) << after.syscr - before.syscr
+			<< std::setw(13) << after.syscw - before.syscw
+			<< "  " << note << std::endl;
+}
+
+// Sleeps until something wakes the main loop, but never longer than a second
+static void wait_briefly() {
+	loop::wait_until(util::seconds_since_epoch() + 1);
+}
+
+// Has a plain session download real data from the seeding sessions over loopback, which shows what the session profile does for upload throughput and memory
+static void serve(std::ostream &report, uint64_t bytes) {
+	const uint32_t count = 16;
+	std::filesystem::path dir = "serve";
+	synthetic::generate_seedable(dir / "torrents", dir / "seed", count, bytes / count);
+
+	lt::settings_pack settings;
+	settings.set_str(lt::settings_pack::listen_interfaces, "127.0.0.1:0");
+	settings.set_bool(lt::settings_pack::enable_dht, false);
+	settings.set_bool(lt::settings_pack::enable_lsd, false);
+	settings.set_bool(lt::settings_pack::enable_upnp, false);
+	settings.set_bool(lt::settings_pack::enable_natpmp, false);
+	lt::session leecher(settings);
+
+	sample before = take_sample();
+	std::vector<lt::torrent_handle> handles;
+	for (uint32_t i = 0; i < count; i++) {
+		auto torrent_info = std::make_shared<lt::torrent_info>((dir / "torrents" / ("seedable-" + std::to_string(i) + ".torrent")).string());
+		lt::session &seeder = session_of(torrent_info->info_hashes().get_best());
+
+		// Neither side is queued behind the torrents of the earlier phases
+		lt::add_torrent_params seed;
+		seed.ti = std::make_shared<lt::torrent_info>(*torrent_info);
+		seed.save_path = (dir / "seed").string();
+		seed.flags |= lt::torrent_flags::seed_mode; // The data was just hashed
+		seed.flags &= ~lt::torrent_flags::auto_managed;
+		seeder.add_torrent(seed);
+
+		lt::add_torrent_params leech;
+		leech.ti = torrent_info;
+		leech.save_path = (dir / "leech").string();
+		leech.flags &= ~lt::torrent_flags::auto_managed;
+		lt::torrent_handle handle = leecher.add_torrent(leech);
+		handle.connect_peer(lt::tcp::endpoint(lt::make_address("127.0.0.1"), seeder.listen_port()));
+		handles.push_back(handle);
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(120);
+	uint64_t downloaded = 0;
+	bool finished = false;
+	while (!finished && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		downloaded = 0;
+		finished = true;
+		for (const lt::torrent_handle &handle : handles) {
+			lt::torrent_status status = handle.status();
+			downloaded += static_cast<uint64_t>(status.total_done);
+			finished = finished && status.is_seeding;
+		}
+	}
+
+	sample after = take_sample();
+	double seconds = std::chrono::duration<double>(after.time - before.time).count();
+	std::ostringstream note;
+	note << std::fixed << std::setprecision(1) << (downloaded / 1024.0 / 1024.0 / seconds) << " MiB/s uploaded" << (finished ? "" : ", timed out");
+	print_result(report, "serve", count, before, after, 1, note.str());
+}
+
+// Runs every phase at a single scale. Each scale runs in its own process, so that memory usage is not carried over.
+static int run(uint32_t count, uint64_t size, uint32_t session_count, const std::string &profile_name, uint64_t memory_budget, uint64_t serve_bytes, bool verbose) {
+	std::filesystem::path workdir = std::filesystem::temp_directory_path() / ("btup_bench_" + std::to_string(count));
+	std::filesystem::remove_all(workdir);
+	std::filesystem::create_directories(workdir);
+	std::filesystem::current_path(workdir); // Statistics are kept in the working directory
+
+	std::ostream &report = std::cout;
+
+	// The program reports every torrent it touches, which would drown the results
+	std::vector<std::string> args{"btup_bench", "--update-delay", "3600", "--max-parallel-recounts", "1000", "--max-upload-rate", "12800", "--sessions", std::to_string(session_count), "--listen-port", "0",
+			"--session-profile", profile_name, "--memory-budget", std::to_string(memory_budget), "--log-level", verbose ? "info" : "error"};
+	std::vector<char *> argv;
+	for (std::string &arg : args)
+		argv.push_back(arg.data());
+	config::init(static_cast<int>(argv.size()), argv.data());
+	logger::start();
+
+	loop::init();
+
+	{
+		lt::settings_pack settings;
+		settings.set_bool(lt::settings_pack::enable_dht, false);
+		settings.set_bool(lt::settings_pack::enable_lsd, false);
+		settings.set_bool(lt::settings_pack::enable_upnp, false);
+		settings.set_bool(lt::settings_pack::enable_natpmp, false);
+		settings.set_int(lt::settings_pack::alert_mask, lt::alert_category::error | lt::alert_category::status | lt::alert_category::storage);
+		profile::apply(settings);
+		start_sessions(settings);
+	}
+
+	describe_metrics();
+
+	tracker::start();
+	scrape::start();
+	loader::start();
+	deletion::start();
+
+	sample before = take_sample();
+	synthetic::generate(config::torrents_dir(), count, size, {tracker::http_announce_url(), tracker::udp_announce_url()});
+	print_result(report, "generate", count, before, take_sample(), 0);
+
+	stats::try_load();
+	last_update_time = util::seconds_since_epoch(); // The benchmark runs updates by itself
+
+	before = take_sample();
+	discover_new_torrents_and_unregister_deleted_ones();
+	print_result(report, "discover", count, before, take_sample(), 1);
+
+	// Discovered files are parsed and identified on the loader's threads
+	before = take_sample();
+	while (!identifying_files.empty()) {
+		wait_briefly();
+		process_loaded_torrents();
+	}
+	print_result(report, "identify", count, before, take_sample(), 0, std::to_string(stats::size()) + " registered");
+
+	before = take_sample();
+	uint32_t cycles = 0;
+	while (true) {
+		finish_timed_out_recounting_tickets();
+		start_recounting_seeders();
+		process_loaded_torrents();
+		process_libtorrent_alerts();
+		process_scrape_results();
+		cycles++;
+
+		if (recounting_torrents.size() == 0 && loading_recounts.empty() && scheduler::next_due_time() > util::seconds_since_epoch())
+			break;
+		loop::wait_until(std::min(next_deadline(), util::seconds_since_epoch() + 1));
+	}
+	print_result(report, "recount", count, before, take_sample(), cycles, std::to_string(tracker::scraped()) + " scraped");
+
+	// The first pass requests the torrents to be loaded, the second one starts seeding them
+	before = take_sample();
+	for (cycles = 0; cycles < 2; cycles++) {
+		std::vector<stats::torrent_id> torrent_ids;
+		get_torrent_ids_from_stats(torrent_ids);
+		sort_torrent_ids_by_score(torrent_ids);
+		manage_torrent_seeding(torrent_ids);
+
+		while (!loading_torrents.empty()) {
+			wait_briefly();
+			process_loaded_torrents();
+		}
+	}
+	print_result(report, "manage", count, before, take_sample(), cycles, std::to_string(seeding_torrents.size()) + " seeding");
+
+	// Ranking is the only part of an update that grows faster than linearly
+	before = take_sample();
+	for (cycles = 0; cycles < 10; cycles++) {
+		std::vector<stats::torrent_id> torrent_ids;
+		get_torrent_ids_from_stats(torrent_ids);
+		sort_torrent_ids_by_score(torrent_ids);
+	}
+	print_result(report, "sort", count, before, take_sample(), cycles);
+
+	before = take_sample();
+	for (cycles = 0; cycles < 10; cycles++)
+		allocate_upload();
+	print_result(report, "allocate", count, before, take_sample(), cycles);
+
+	// Nothing changes anymore, which is what almost every update of a long running process looks like
+	before = take_sample();
+	for (cycles = 0; cycles < 10; cycles++)
+		run_update();
+	print_result(report, "update", count, before, take_sample(), cycles);
+
+	before = take_sample();
+	stats::_last_compaction_time = 0;
+	stats::try_save();
+	bool compacted = stats::_compaction_thread.joinable();
+	stats::close(); // Waits for the compaction
+	print_result(report, "save", count, before, take_sample(), 1, compacted ? "compacted" : "journal only");
+
+	before = take_sample();
+	stats::clear();
+	stats::try_load();
+	print_result(report, "load", count, before, take_sample(), 1, std::to_string(stats::size()) + " loaded");
+
+	if (serve_bytes != 0)
+		serve(report, serve_bytes);
+
+	scrape::stop();
+	loader::stop();
+	deletion::stop();
+	stats::close();
+	tracker::stop();
+	logger::stop();
+
+	std::filesystem::current_path(std::filesystem::temp_directory_path());
+	std::filesystem::remove_all(workdir);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	try {
+		std::vector<uint32_t> counts;
+		uint64_t size = 1024; // KiB per torrent
+		uint32_t session_count = 1;
+		std::vector<std::string> profiles;
+		uint64_t memory_budget = 0; // MiB
+		uint64_t serve_size = 64; // MiB
+		bool verbose = false;
+		int64_t run_count = -1;
+
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+
+			if (arg == "--help" || arg == "-h") {
+				std::cout << "Usage: " << argv[0] << " [options] [torrent counts...]" << std::endl;
+				std::cout << "Runs every phase of the update loop against synthetic torrents and a local mock tracker. (default counts: 1000 10000 100000)" << std::endl;
+				std::cout << "Options:" << std::endl;
+				std::cout << "	--help (-h)                                  Show this message." << std::endl;
+				std::cout << "	--size (-s) {kibibytes}                      Size of the data of each synthetic torrent. (default: 1024)" << std::endl;
+				std::cout << "	--sessions (-n) {count}                      Number of LibTorrent sessions to seed with. (default: 1)" << std::endl;
+				std::cout << "	--profile (-o) {name}                        Session profile to run with. Can be given several times to compare them. (default: default)" << std::endl;
+				std::cout << "	--memory-budget (-b) {mebibytes}             Memory budget to fit the sessions into. Disabled if {mebibytes} is 0. (default: 0)" << std::endl;
+				std::cout << "	--serve (-S) {mebibytes}                     Real data a local leecher downloads from the sessions to measure upload throughput. Disabled if {mebibytes} is 0. (default: 64)" << std::endl;
+				std::cout << "	--verbose (-V)                               Show what the program prints while being benchmarked." << std::endl;
+				return 0;
+			} else if (arg == "--size" || arg == "-s") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --size.");
+				size = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--sessions" || arg == "-n") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --sessions.");
+				session_count = std::stoul(argv[i + 1]);
+				i++;
+			} else if (arg == "--profile" || arg == "-o") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --profile.");
+				profiles.push_back(argv[i + 1]);
+				i++;
+			} else if (arg == "--memory-budget" || arg == "-b") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --memory-budget.");
+				memory_budget = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--serve" || arg == "-S") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --serve.");
+				serve_size = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--verbose" || arg == "-V") {
+				verbose = true;
+			} else if (arg == "--run") {
+				// Used internally to run a single scale in a child process
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --run.");
+				run_count = std::stoll(argv[i + 1]);
+				i++;
+			} else
+				counts.push_back(std::stoul(arg));
+		}
+
+		if (profiles.empty())
+			profiles.push_back("default");
+
+		if (run_count >= 0)
+			return run(static_cast<uint32_t>(run_count), size * 1024, session_count, profiles.front(), memory_budget, serve_size * 1024 * 1024, verbose);
+
+		if (counts.empty())
+			counts = {1000, 10000, 100000};
+
+		for (const std::string &profile_name : profiles) {
+			std::cout << "Session profile: " << profile_name << std::endl;
+			print_header(std::cout);
+
+			for (uint32_t count : counts) {
+				std::vector<std::string> args{"btup_bench", "--run", std::to_string(count), "--size", std::to_string(size), "--sessions", std::to_string(session_count),
+						"--profile", profile_name, "--memory-budget", std::to_string(memory_budget), "--serve", std::to_string(serve_size)};
+				if (verbose)
+					args.push_back("--verbose");
+
+				std::vector<char *> child_argv;
+				for (std::string &arg : args)
+					child_argv.push_back(arg.data());
+				child_argv.push_back(nullptr);
+
+				pid_t pid;
+				if (posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, child_argv.data(), environ) != 0)
+					throw std::runtime_error("Unable to start the benchmark of " + std::to_string(count) + " torrents.");
+
+				int status;
+				waitpid(pid, &status, 0);
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+					std::cout << "Benchmark of " << count << " torrents failed." << std::endl;
+			}
+
+			std::cout << std::endl;
+		}
+	} catch (std::exception &e) {
+		std::cerr << "Fatal Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include <synthetic.hpp>
+#include <pch.hpp>
+
+#include <libtorrent/create_torrent.hpp>
+
+namespace synthetic {
+	void generate(const std::filesystem::path &dir, uint32_t count, uint64_t size, const std::vector<std::string> &trackers) {
+		std::filesystem::create_directories(dir);
+
+		for (uint32_t i = 0; i < count; i++) {
+			std::string name = "synthetic-" + std::to_string(i);
+
+			lt::file_storage files;
+			files.add_file(name + ".bin", static_cast<int64_t>(size));
+
+			// Hybrid torrents would need v2 hashes of real data
+			lt::create_torrent torrent(files, 0, lt::create_torrent::v1_only);
+			torrent.add_tracker(trackers[i % trackers.size()]);
+
+			// The pieces are never verified, so any hash will do as long as every torrent gets a different info-hash
+			for (int piece = 0; piece < torrent.num_pieces(); piece++) {
+				lt::sha1_hash hash;
+				uint64_t seed = (uint64_t(i) << 32) | uint32_t(piece);
+				for (size_t byte = 0; byte < hash.size(); byte++) {
+					seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+					hash.data()[byte] = static_cast<char>(seed >> 56);
+				}
+				torrent.set_hash(lt::piece_index_t(piece), hash);
+			}
+
+			std::vector<char> buffer;
+			lt::bencode(std::back_inserter(buffer), torrent.generate());
+
+			std::ofstream file(dir / (name + ".torrent"), std::ios::binary | std::ios::trunc);
+			file.write(buffer.data(), buffer.size());
+			if (!file)
+				throw std::runtime_error("Unable to write \"" + (dir / (name + ".torrent")).string() + "\".");
+		}
+	}
+
+	void generate_seedable(const std::filesystem::path &dir, const std::filesystem::path &data_dir, uint32_t count, uint64_t size) {
+		std::filesystem::create_directories(dir);
+		std::filesystem::create_directories(data_dir);
+
+		uint64_t seed = 0x9E3779B97F4A7C15ULL;
+		std::vector<char> chunk(1024 * 1024);
+		for (uint32_t i = 0; i < count; i++) {
+			std::string name = "seedable-" + std::to_string(i);
+
+			std::ofstream data(data_dir / (name + ".bin"), std::ios::binary | std::ios::trunc);
+			for (uint64_t written = 0; written < size; written += chunk.size()) {
+				for (char &byte : chunk) {
+					seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+					byte = static_cast<char>(seed >> 56);
+				}
+				data.write(chunk.data(), static_cast<std::streamsize>(std::min<uint64_t>(chunk.size(), size - written)));
+			}
+			data.close();
+			if (!data)
+				throw std::runtime_error("Unable to write \"" + (data_dir / (name + ".bin")).string() + "\".");
+
+			lt::file_storage files;
+			files.add_file(name + ".bin", static_cast<int64_t>(size));
+			lt::create_torrent torrent(files, 0, lt::create_torrent::v1_only);
+
+			lt::error_code error;
+			lt::set_piece_hashes(torrent, data_dir.string(), error);
+			if (error)
+				throw std::runtime_error("Unable to hash \"" + name + "\": " + error.message());
+
+			std::vector<char> buffer;
+			lt::bencode(std::back_inserter(buffer), torrent.generate());
+
+			std::ofstream file(dir / (name + ".torrent"), std::ios::binary | std::ios::trunc);
+			file.write(buffer.data(), buffer.size());
+			if (!file)
+				throw std::runtime_error("Unable to write \"" + (dir / (name + ".torrent")).string() + "\".");
+		}
+	}
+}
@@ -0,0 +1,13 @@
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Generates .torrent files of data that does not exist, which is enough for everything except actually downloading it
+namespace synthetic {
+	// Writes count single-file torrents of size bytes each into dir, named synthetic-{index}.torrent. Trackers are assigned in turn.
+	void generate(const std::filesystem::path &dir, uint32_t count, uint64_t size, const std::vector<std::string> &trackers);
+
+	// Writes count single-file torrents of size bytes of pseudo-random data each, named seedable-{index}. The data is written to data_dir and hashed, so the torrents can really be downloaded.
+	void generate_seedable(const std::filesystem::path &dir, const std::filesystem::path &data_dir, uint32_t count, uint64_t size);
+}
@@ -0,0 +1,255 @@
+#include <tracker.hpp>
+#include <pch.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace tracker {
+	static const uint64_t udp_protocol_id = 0x41727101980ULL;
+	static const uint32_t udp_action_connect = 0;
+	static const uint32_t udp_action_announce = 1;
+	static const uint32_t udp_action_scrape = 2;
+
+	struct client {
+		int fd;
+		std::string request;
+	};
+
+	static void write_u32(std::string &buffer, uint32_t value) {
+		for (int shift = 24; shift >= 0; shift -= 8)
+			buffer += static_cast<char>((value >> shift) & 0xFF);
+	}
+
+	static uint32_t read_u32(const char *data) {
+		const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+		return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+	}
+
+	static int open_socket(int type, uint16_t &port) {
+		int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to create the mock tracker socket");
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = 0; // Let the kernel pick a free port
+
+		socklen_t length = sizeof(address);
+		if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to bind the mock tracker socket");
+		if (type == SOCK_STREAM && listen(fd, 128) != 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to listen on the mock tracker socket");
+
+		port = ntohs(address.sin_port);
+		return fd;
+	}
+
+	static int hex_value(char c) {
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	static std::string url_decode(std::string_view value) {
+		std::string result;
+		for (size_t i = 0; i < value.size(); i++) {
+			if (value[i] == '%' && i + 2 < value.size() && hex_value(value[i + 1]) >= 0 && hex_value(value[i + 2]) >= 0) {
+				result += static_cast<char>(hex_value(value[i + 1]) * 16 + hex_value(value[i + 2]));
+				i += 2;
+			} else
+				result += value[i];
+		}
+		return result;
+	}
+
+	static std::string bencode_string(const std::string &value) {
+		return std::to_string(value.size()) + ":" + value;
+	}
+
+	static std::string handle_http(const std::string &request) {
+		// Only the request line matters: GET {target} HTTP/1.x
+		size_t target_begin = request.find(' ');
+		size_t target_end = target_begin == std::string::npos ? std::string::npos : request.find(' ', target_begin + 1);
+		if (target_end == std::string::npos)
+			return "HTTP/1.0 400 Bad Request\r\n\r\n";
+
+		std::string_view target(request.data() + target_begin + 1, target_end - target_begin - 1);
+		std::string_view path = target.substr(0, target.find('?'));
+
+		std::string body;
+		if (path == "/announce")
+			body = "d8:intervali1800e5:peers0:e";
+		else if (path == "/scrape") {
+			body = "d5:filesd";
+
+			std::string_view query = target.size() > path.size() ? target.substr(path.size() + 1) : std::string_view();
+			while (!query.empty()) {
+				std::string_view parameter = query.substr(0, query.find('&'));
+				query.remove_prefix(std::min(query.size(), parameter.size() + 1));
+
+				if (!parameter.starts_with("info_hash="))
+					continue;
+
+				std::string info_hash = url_decode(parameter.substr(10));
+				if (info_hash.size() != lt::sha1_hash::size())
+					continue;
+
+				lt::sha1_hash hash;
+				std::memcpy(hash.data(), info_hash.data(), info_hash.size());
+				body += bencode_string(info_hash) + "d8:completei" + std::to_string(seeders(hash)) + "e10:downloadedi0e10:incompletei0ee";
+				_scraped++;
+			}
+
+			body += "ee";
+		} else
+			return "HTTP/1.0 404 Not Found\r\n\r\n";
+
+		return "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+	}
+
+	static void handle_udp() {
+		char packet[2048];
+		sockaddr_storage address;
+		socklen_t address_length = sizeof(address);
+
+		ssize_t length;
+		while ((length = recvfrom(_udp_fd, packet, sizeof(packet), 0, reinterpret_cast<sockaddr *>(&address), &address_length)) >= 16) {
+			uint32_t action = read_u32(packet + 8);
+			uint32_t transaction_id = read_u32(packet + 12);
+
+			std::string reply;
+			if (action == udp_action_connect && (uint64_t(read_u32(packet)) << 32 | read_u32(packet + 4)) == udp_protocol_id) {
+				write_u32(reply, udp_action_connect);
+				write_u32(reply, transaction_id);
+				write_u32(reply, 0x12345678); // Any connection ID is accepted later on
+				write_u32(reply, 0x9ABCDEF0);
+			} else if (action == udp_action_announce) {
+				write_u32(reply, udp_action_announce);
+				write_u32(reply, transaction_id);
+				write_u32(reply, 1800); // Interval
+				write_u32(reply, 0); // Leechers
+				write_u32(reply, 0); // Seeders
+			} else if (action == udp_action_scrape) {
+				write_u32(reply, udp_action_scrape);
+				write_u32(reply, transaction_id);
+				for (ssize_t offset = 16; offset + static_cast<ssize_t>(lt::sha1_hash::size()) <= length; offset += lt::sha1_hash::size()) {
+					lt::sha1_hash hash;
+					std::memcpy(hash.data(), packet + offset, hash.size());
+					write_u32(reply, seeders(hash));
+					write_u32(reply, 0); // Completed
+					write_u32(reply, 0); // Leechers
+					_scraped++;
+				}
+			} else
+				continue;
+
+			sendto(_udp_fd, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr *>(&address), address_length);
+			address_length = sizeof(address);
+		}
+	}
+
+	static void run() {
+		std::vector<client> clients;
+
+		while (_running) {
+			std::vector<pollfd> fds{{_http_fd, POLLIN, 0}, {_udp_fd, POLLIN, 0}};
+			for (const client &client : clients)
+				fds.push_back({client.fd, POLLIN, 0});
+
+			if (poll(fds.data(), fds.size(), 100) <= 0)
+				continue;
+
+			if (fds[0].revents & POLLIN) {
+				int fd;
+				while ((fd = accept4(_http_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+					clients.push_back({fd, ""});
+			}
+
+			if (fds[1].revents & POLLIN)
+				handle_udp();
+
+			for (size_t i = 2; i < fds.size(); i++) {
+				if (!fds[i].revents)
+					continue;
+
+				client &client = clients[i - 2];
+				char buffer[4096];
+				ssize_t length = recv(client.fd, buffer, sizeof(buffer), 0);
+				if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					continue;
+				if (length > 0)
+					client.request.append(buffer, length);
+				if (length > 0 && client.request.find("\r\n\r\n") == std::string::npos)
+					continue;
+
+				if (length > 0) {
+					// Replies are small enough to fit into the socket buffer at once
+					std::string response = handle_http(client.request);
+					[[maybe_unused]] ssize_t result = send(client.fd, response.data(), response.size(), MSG_NOSIGNAL);
+				}
+
+				close(client.fd);
+				client.fd = -1;
+			}
+
+			std::erase_if(clients, [](const client &client) {
+				return client.fd < 0;
+			});
+		}
+
+		for (const client &client : clients)
+			close(client.fd);
+	}
+
+	uint32_t seeders(const lt::sha1_hash &info_hash) {
+		const auto *bytes = reinterpret_cast<const unsigned char *>(info_hash.data());
+		if (bytes[0] < 3)
+			return 1;
+		return 3 + bytes[1] % 20;
+	}
+
+	void start() {
+		_http_fd = open_socket(SOCK_STREAM, _http_port);
+		_udp_fd = open_socket(SOCK_DGRAM, _udp_port);
+
+		_running = true;
+		_thread = std::thread(run);
+	}
+
+	void stop() {
+		_running = false;
+		if (_thread.joinable())
+			_thread.join();
+
+		close(_http_fd);
+		close(_udp_fd);
+	}
+
+	std::string http_announce_url() {
+		return "http://127.0.0.1:" + std::to_string(_http_port) + "/announce";
+	}
+
+	std::string udp_announce_url() {
+		return "udp://127.0.0.1:" + std::to_string(_udp_port) + "/announce";
+	}
+
+	uint64_t scraped() {
+		return _scraped;
+	}
+
+	std::thread _thread;
+	std::atomic<bool> _running = false;
+	int _http_fd = -1;
+	int _udp_fd = -1;
+	uint16_t _http_port = 0;
+	uint16_t _udp_port = 0;
+	std::atomic<uint64_t> _scraped = 0;
+}
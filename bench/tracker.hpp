@@ -0,0 +1,31 @@
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include <libtorrent/sha1_hash.hpp>
+
+// Local HTTP and UDP tracker that answers scrapes with scripted seeder counts and announces with an empty peer list
+namespace tracker {
+	// Returns the number of seeders the tracker reports for the torrent. About 1% of torrents get a single seeder, the rest between 3 and 22.
+	uint32_t seeders(const lt::sha1_hash &info_hash);
+
+	void start();
+
+	void stop();
+
+	std::string http_announce_url();
+
+	std::string udp_announce_url();
+
+	// Returns the number of info-hashes scraped so far over both protocols
+	uint64_t scraped();
+
+	extern std::thread _thread;
+	extern std::atomic<bool> _running;
+	extern int _http_fd;
+	extern int _udp_fd;
+	extern uint16_t _http_port;
+	extern uint16_t _udp_port;
+	extern std::atomic<uint64_t> _scraped;
+}
@@ -0,0 +1,1209 @@
+#include <app.hpp>
+#include <pch.hpp>
+
+#include <util.hpp>
+#include <config.hpp>
+#include <metainfo.hpp>
+#include <watcher.hpp>
+#include <loop.hpp>
+#include <scheduler.hpp>
+#include <scrape.hpp>
+#include <ledger.hpp>
+#include <resume.hpp>
+#include <loader.hpp>
+#include <deletion.hpp>
+#include <metrics.hpp>
+#include <logger.hpp>
+#include <partial.hpp>
+#include <health.hpp>
+#include <bandwidth.hpp>
+#include <profile.hpp>
+
+std::vector<std::unique_ptr<lt::session>> sessions;
+uint64_t last_update_time = 0; // Forces update on the first iteration of the main loop
+bool data_dir_scanned = false;
+loop_series loop_metrics{};
+const uint64_t recount_timeout = 30; // Wait no more than 30 seconds for a tracker that has not answered often enough to know its latency, and give the DHT as long to find peers
+const size_t max_trackers_per_recount = 3; // Scrape at most 3 trackers of a torrent before looking it up in the DHT
+registry recounting_torrents;
+registry seeding_torrents;
+uint64_t last_resume_save_time = 0;
+const uint64_t resume_save_interval = 5 * 60; // Save resume data of modified torrents every 5 minutes
+uint64_t last_session_state_save_time = 0;
+const uint64_t session_state_save_interval = 15 * 60; // Save the DHT routing tables every 15 minutes, so that even a crash keeps most of them
+uint32_t resume_saves_outstanding = 0;
+uint64_t last_upload_sample_time = 0;
+const uint64_t upload_sample_interval = 5 * 60; // Fold the upload of seeding torrents into their statistics every 5 minutes
+uint64_t last_memory_check_time = 0;
+const uint64_t memory_check_interval = 10; // Measure the resident memory and compare it with the memory budget every 10 seconds
+std::unordered_set<std::string> loading_torrents; // Torrents the loader is preparing to be seeded
+std::unordered_set<std::string> loading_recounts; // Torrents whose trackers the loader is reading to start their recount
+std::unordered_map<std::string, lt::add_torrent_params> prepared_torrents;
+std::unordered_map<std::string, uint64_t> identifying_files; // Files the loader is parsing to find out which torrent they describe, by the generation of the latest parse
+std::unordered_set<std::string> torrents_without_files; // Torrents whose last file is gone, checked again before they are unregistered
+std::unordered_map<std::string, uint64_t> selecting_torrents; // Partially seeded torrents by the time their pieces are chosen
+
+void start_sessions(lt::settings_pack settings) {
+	for (uint32_t i = 0; i < config::sessions(); i++) {
+		std::string port = std::to_string(config::listen_port() == 0 ? 0 : config::listen_port() + i);
+		settings.set_str(lt::settings_pack::listen_interfaces, "0.0.0.0:" + port + ",[::]:" + port);
+
+		// A DHT that starts from the nodes it knew before is useful for recounts within seconds instead of minutes
+		lt::session_params params;
+		if (resume::load_session(i, params))
+			logger::debug() << "Restored the DHT state of session " << i << ".";
+		params.settings = settings;
+
+		// A hard ceiling on top of the limits of the torrents, in case they ever add up to more than the uplink
+		if (config::max_upload_rate() != 0)
+			params.settings.set_int(lt::settings_pack::upload_rate_limit, static_cast<int>(std::min<uint64_t>(config::max_upload_rate() / config::sessions(), std::numeric_limits<int>::max())));
+
+		auto session = std::make_unique<lt::session>(std::move(params));
+
+		// Wake up the main loop as soon as LibTorrent has alerts to process
+		session->set_alert_notify([]() {
+			loop::notify();
+		});
+
+		sessions.push_back(std::move(session));
+	}
+}
+
+lt::session &session_of(const lt::sha1_hash &info_hash) {
+	// Info-hashes are uniformly distributed already
+	uint32_t value;
+	std::memcpy(&value, info_hash.data(), sizeof(value));
+	return *sessions[value % sessions.size()];
+}
+
+void register_torrent(const std::string &name) {
+	stats::torrent_id id = stats::set(name, { 0, std::numeric_limits<uint32_t>::max() });
+	scheduler::schedule(id, 0, 0);
+}
+
+void unregister_torrent(const std::string &name) {
+	std::vector<std::string> files = stats::files_of(name);
+
+	stats::torrent_id id = stats::find(name);
+	if (id != stats::no_id)
+		scheduler::unschedule(id);
+	stats::remove(name);
+
+	bool any_file_exists = false;
+	for (const std::string &file : files) {
+		std::filesystem::path torrent_path = config::torrents_dir() / file;
+		metainfo::forget(torrent_path);
+
+		if (std::filesystem::exists(torrent_path)) {
+			stats::link(file, name);
+			any_file_exists = true;
+		}
+	}
+
+	if (any_file_exists)
+		register_torrent(name);
+}
+
+void discover_file(const std::string &file) {
+	if (stats::name_of_file(file) || identifying_files.contains(file))
+		return;
+
+	// A file that is forgotten and discovered again while it is being parsed is parsed again, and only the latest parse counts
+	static uint64_t generation = 0;
+	identifying_files[file] = ++generation;
+	loader::request(file, "", loader::purpose::identify, generation); // Parsing the file also fills the metainfo cache for the first recount
+}
+
+void forget_file(const std::string &file) {
+	identifying_files.erase(file);
+
+	const std::string *name = stats::name_of_file(file);
+	std::string owner = name ? *name : ""; // Copied, because unlinking the last file frees the name
+	stats::unlink(file);
+	if (!owner.empty() && stats::files_of(owner).empty())
+		torrents_without_files.insert(std::move(owner));
+
+	metainfo::forget(config::torrents_dir() / file);
+}
+
+void identify_file(const std::string &file, const std::string &name) {
+	stats::link(file, name);
+
+	if (stats::contains(name)) {
+		const std::vector<std::string> &files = stats::files_of(name);
+		if (files.size() > 1)
+			logger::info(name) << "File \"" << file << "\" is a duplicate of \"" << files.front() << "\". Both share the statistics and data of \"" << name << "\".";
+		return;
+	}
+
+	// Older versions kept statistics and data under the name of the file
+	if (stats::contains(file) && stats::files_of(file).empty()) {
+		logger::info(name) << "Moving statistics and data of \"" << file << "\" to \"" << name << "\".";
+		migrate_torrent(file, name);
+		return;
+	}
+
+	logger::info(name) << "Registering \"" << file << "\" as \"" << name << "\".";
+	register_torrent(name);
+}
+
+void migrate_torrent(const std::string &from, const std::string &to) {
+	stats::torrent_id id = stats::find(from);
+	stats::torrent torrent = stats::get(id);
+	scheduler::unschedule(id);
+	stats::remove(from);
+
+	id = stats::set(to, torrent);
+	scheduler::schedule(id, torrent.last_recounting_time, torrent.recount_interval);
+
+	std::filesystem::path old_data_path = config::data_dir() / from;
+	std::filesystem::path new_data_path = config::data_dir() / to;
+	std::error_code error;
+	if (std::filesystem::exists(old_data_path) && !std::filesystem::exists(new_data_path)) {
+		std::filesystem::rename(old_data_path, new_data_path, error);
+		if (error)
+			logger::warning(to) << "Unable to move the data of \"" << from << "\": " << error.message();
+		else if (data_dir_scanned) {
+			ledger::remove(from);
+			ledger::set(to, ledger::measure(new_data_path));
+		}
+	}
+
+	resume::rename(from, to);
+}
+
+void unregister_torrents_without_files() {
+	// A renamed file is only known to belong to its torrent once it has been identified again
+	if (!identifying_files.empty())
+		return;
+
+	// Torrents that got a file back in the meantime are kept
+	uint32_t torrents_unregistered = 0;
+	for (const std::string &name : torrents_without_files) {
+		stats::torrent_id id = stats::find(name);
+		if (id == stats::no_id || !stats::files_of(name).empty())
+			continue;
+
+		scheduler::unschedule(id);
+		stats::remove(name);
+		torrents_unregistered++;
+	}
+	torrents_without_files.clear();
+
+	if (torrents_unregistered != 0)
+		logger::info() << "Unregistered " << torrents_unregistered << " torrent" << (torrents_unregistered == 1 ? "" : "s") << " without any file.";
+}
+
+void record_recount(const std::string &name, uint32_t number_of_seeders, int32_t number_of_leechers, int32_t number_of_downloads) {
+	uint64_t now = util::seconds_since_epoch();
+
+	// The upload statistics and the recount history outlive recounts
+	stats::torrent_id id = stats::find(name);
+	stats::torrent torrent = id != stats::no_id ? stats::get(id) : stats::torrent{ 0, std::numeric_limits<uint32_t>::max() };
+	torrent.recount_interval = scheduler::adapt_interval(torrent.recount_interval, torrent.number_of_seeders, number_of_seeders);
+	torrent.last_recounting_time = now;
+	torrent.number_of_seeders = number_of_seeders;
+	if (number_of_leechers >= 0)
+		torrent.number_of_leechers = static_cast<uint32_t>(number_of_leechers);
+	if (number_of_downloads >= 0)
+		torrent.number_of_downloads = static_cast<uint32_t>(number_of_downloads);
+
+	id = stats::set(name, torrent);
+	scheduler::schedule(id, now, torrent.recount_interval);
+	logger::debug(name) << "Next recount of \"" << name << "\" is due in " << (torrent.recount_interval / 3600.0F) << " hours.";
+}
+
+void rescan_torrents_dir() {
+	logger::debug() << "Rescanning the torrents directory.";
+
+	std::unordered_set<std::string> present_files;
+
+	std::filesystem::create_directory(config::torrents_dir());
+
+	// Start watching before scanning so that no change made during the scan is missed
+	if (!watcher::init(config::torrents_dir()))
+		logger::warning() << "Unable to watch the torrents directory. It will be rescanned on every update.";
+
+	uint32_t files_discovered = 0;
+	for (auto &item : std::filesystem::directory_iterator(config::torrents_dir())) {
+		if (item.is_directory())
+			continue;
+
+		std::string file = item.path().filename().string();
+		if (!stats::name_of_file(file) && !identifying_files.contains(file)) {
+			discover_file(file);
+			files_discovered++;
+		}
+		present_files.insert(std::move(file));
+	}
+
+	std::vector<std::string> missing_files;
+	for (const auto &[file, name] : stats::files()) {
+		if (!present_files.contains(file))
+			missing_files.push_back(file);
+	}
+	for (const std::string &file : missing_files)
+		forget_file(file);
+
+	// Statistics can outlive their files while the daemon is down, and older versions kept them under the name of the file
+	std::vector<stats::torrent_id> ids;
+	stats::get_ids(ids);
+	for (stats::torrent_id id : ids) {
+		const std::string &name = stats::name_of(id);
+		if (stats::files_of(name).empty())
+			torrents_without_files.insert(name);
+	}
+
+	if (files_discovered != 0 || !missing_files.empty()) {
+		logger::info() << "Discovered " << files_discovered << " new torrent file" << (files_discovered == 1 ? ". " : "s. ")
+				<< missing_files.size() << " torrent file" << (missing_files.size() == 1 ? " is" : "s are") << " gone.";
+	}
+}
+
+void discover_new_torrents_and_unregister_deleted_ones() {
+	logger::debug() << "Discovering new torrents.";
+
+	std::vector<watcher::event> events;
+	if (!watcher::poll(events)) {
+		rescan_torrents_dir();
+	} else {
+		uint32_t files_discovered = 0;
+		uint32_t files_gone = 0;
+
+		// A new file is reported once when it is created and again when it has been written, so only the last event of every file is acted on
+		std::vector<std::string> names;
+		std::unordered_map<std::string, bool> created;
+		for (const auto &event : events) {
+			if (created.insert_or_assign(event.name, event.created).second)
+				names.push_back(event.name);
+		}
+
+		for (const std::string &name : names) {
+			if (stats::name_of_file(name) || identifying_files.contains(name)) {
+				forget_file(name);
+				files_gone++;
+			}
+
+			// A file that is written again might describe a different torrent now
+			if (created.at(name)) {
+				discover_file(name);
+				files_discovered++;
+			}
+		}
+
+		if (files_discovered != 0 || files_gone != 0) {
+			logger::info() << "Discovered " << files_discovered << " new torrent file" << (files_discovered == 1 ? ". " : "s. ")
+					<< files_gone << " torrent file" << (files_gone == 1 ? " is" : "s are") << " gone.";
+		}
+	}
+
+	unregister_torrents_without_files();
+}
+
+void get_torrent_ids_from_stats(std::vector<stats::torrent_id> &ids) {
+	stats::get_ids(ids);
+}
+
+void sort_torrent_ids_by_score(std::vector<stats::torrent_id> &ids) {
+	// Ranking every torrent once up front keeps each comparison down to a couple of loads
+	std::vector<std::pair<scoring::rank, stats::torrent_id>> ranked;
+	ranked.reserve(ids.size());
+	for (stats::torrent_id id : ids)
+		ranked.emplace_back(scoring::rank_of(stats::get(id)), id);
+
+	std::sort(
+		ranked.begin(),
+		ranked.end(),
+		[](const auto &a, const auto &b) {
+			return a.first < b.first;
+		}
+	);
+
+	for (size_t i = 0; i < ranked.size(); i++)
+		ids[i] = ranked[i].second;
+}
+
+void delete_data(const std::string &name) {
+	deletion::enqueue(name);
+	ledger::mark_deleting(name);
+	resume::remove(name);
+}
+
+void purge_data_of_deleted_torrents() {
+	logger::debug() << "Purging data of deleted torrents.";
+
+	// The ledger is kept up to date from then on, so the data directory only has to be measured once
+	if (!data_dir_scanned) {
+		std::filesystem::create_directory(config::data_dir());
+		for (auto &item : std::filesystem::directory_iterator(config::data_dir())) {
+			if (item.is_directory())
+				ledger::set(item.path().filename().string(), ledger::measure(item.path()));
+		}
+
+		// Deletions that were interrupted by the last shutdown are still on disk
+		for (const std::string &name : deletion::pending())
+			ledger::mark_deleting(name);
+
+		data_dir_scanned = true;
+	}
+
+	// Data kept under the name of a file by older versions is moved once the file has been identified
+	if (!identifying_files.empty())
+		return;
+
+	std::vector<std::string> purged_names;
+	for (const auto &[name, bytes] : ledger::get()) {
+		if (!stats::contains(name) && !ledger::is_deleting(name))
+			purged_names.push_back(name);
+	}
+
+	for (const std::string &name : purged_names) {
+		logger::info(name) << "Torrent \"" << name << "\" does not exist.";
+		logger::info(name) << "Queueing deletion of all data belonging to \"" << name << "\".";
+		delete_data(name);
+	}
+
+	if (!purged_names.empty()) {
+		logger::info() << "Purged " << purged_names.size() << " torrent" << (purged_names.size() == 1 ? "'s data." : "s' data.")
+				<< " Size of data pending deletion is " << (ledger::deleting_total() / 1024.0F / 1024.0F / 1024.0F) << " GiB.";
+	}
+}
+
+void sample_upload(torrent_userdata &userdata) {
+	uint64_t now = util::seconds_since_epoch();
+	stats::torrent_id id = stats::find(userdata.name);
+	if (id == stats::no_id || now <= userdata.sample_time)
+		return;
+
+	uint64_t bytes_uploaded = static_cast<uint64_t>(std::max<int64_t>(0, userdata.total_upload - userdata.sampled_upload));
+	stats::torrent torrent = stats::get(id);
+	scoring::fold(torrent, bytes_uploaded, now - userdata.sample_time);
+	stats::set(id, torrent);
+	metrics::add("btup_uploaded_bytes_total", "", static_cast<double>(bytes_uploaded));
+
+	userdata.upload_rate = static_cast<double>(bytes_uploaded) / static_cast<double>(now - userdata.sample_time);
+	userdata.sampled_upload = userdata.total_upload;
+	userdata.sample_time = now;
+}
+
+void stop_seeding(torrent_userdata &userdata) {
+	sample_upload(userdata);
+
+	if (userdata.handle.is_valid() && userdata.handle.in_session())
+		// Remove the torrent from session if it is already added
+		session_of(userdata.info_hash).remove_torrent(userdata.handle);
+
+	selecting_torrents.erase(userdata.name);
+
+	// Only the reservation made for a download that never finished is released, the data itself stays on disk
+	ledger::set(userdata.name, ledger::measure(config::data_dir() / userdata.name));
+	seeding_torrents.erase(userdata); // Remove the torrent from the seeding list
+}
+
+void seed_all_pieces(torrent_userdata &userdata, uint64_t data_size) {
+	std::shared_ptr<const lt::torrent_info> info = userdata.handle.torrent_file();
+	if (info)
+		userdata.handle.prioritize_pieces(std::vector<lt::download_priority_t>(static_cast<size_t>(info->num_pieces()), lt::default_priority));
+	userdata.handle.unset_flags(lt::torrent_flags::upload_mode);
+
+	selecting_torrents.erase(userdata.name);
+	userdata.partial_share = 0;
+	ledger::set(userdata.name, std::max(data_size, ledger::get(userdata.name)));
+}
+
+void allocate_upload() {
+	if (config::max_upload_rate() == 0)
+		return;
+
+	logger::debug() << "Allocating upload bandwidth.";
+
+	// Torrents that are still being added get their share as well, so that the limits they start with fit into the uplink
+	std::vector<torrent_userdata *> torrents;
+	std::vector<bandwidth::claim> claims;
+	for (torrent_userdata *userdata : seeding_torrents) {
+		stats::torrent_id id = stats::find(userdata->name);
+		if (id == stats::no_id)
+			continue;
+
+		// Torrents that have not been sampled yet might need any amount
+		double demand = userdata->upload_rate < 0 ? std::numeric_limits<double>::infinity() : std::max(bandwidth::min_demand, bandwidth::demand_headroom * userdata->upload_rate);
+		claims.push_back(bandwidth::claim{bandwidth::weight_of(stats::get(id), userdata->partial_share == 0), demand});
+		torrents.push_back(userdata);
+	}
+
+	std::vector<double> rates;
+	bandwidth::allocate(config::max_upload_rate(), claims, rates);
+
+	std::vector<double> limits(torrents.size());
+	for (size_t i = 0; i < torrents.size(); i++) {
+		double current = static_cast<double>(torrents[i]->upload_limit);
+		limits[i] = std::max(bandwidth::min_rate, torrents[i]->upload_limit == 0 ? rates[i] : bandwidth::smooth(current, rates[i]));
+	}
+	bandwidth::fit(config::max_upload_rate(), limits);
+
+	for (size_t i = 0; i < torrents.size(); i++) {
+		torrent_userdata &userdata = *torrents[i];
+		double current = static_cast<double>(userdata.upload_limit);
+
+		// Every change is a call into the session, so limits a little below their target are left alone. Keeping a lower limit never breaks the uplink.
+		if (userdata.upload_limit != 0 && limits[i] >= current && limits[i] - current <= current * bandwidth::change_threshold)
+			continue;
+
+		userdata.upload_limit = std::max(static_cast<int>(limits[i]), 1); // LibTorrent takes a limit of 0 to mean unlimited
+
+		// Torrents that are still being added are limited once their session has them
+		if (userdata.handle.is_valid() && userdata.handle.in_session())
+			apply_upload_limit(userdata);
+	}
+}
+
+void apply_upload_limit(torrent_userdata &userdata) {
+	int unchoke_slots = bandwidth::unchoke_slots_of(userdata.upload_limit);
+	userdata.handle.set_upload_limit(userdata.upload_limit);
+	userdata.handle.set_max_uploads(unchoke_slots);
+	userdata.handle.set_max_connections(unchoke_slots * bandwidth::connections_per_unchoke_slot);
+}
+
+void manage_torrent_seeding(const std::vector<stats::torrent_id> &torrent_ids) {
+	logger::debug() << "Checking the seeding list.";
+	
+	// torrent_ids is sorted by descending score, so the torrents expected to serve the most get the disk space first
+	// Evictions follow the same ranking
+	ledger::rerank();
+
+	for (stats::torrent_id id : torrent_ids) {
+		if (!stats::contains(id))
+			continue;
+
+		std::string name = stats::name_of(id); // Copied, because unregistering the torrent frees its name
+		const stats::torrent &torrent = stats::get(id);
+
+		// Torrents without files are waiting to be identified again or unregistered
+		const std::vector<std::string> &files = stats::files_of(name);
+		if (files.empty())
+			continue;
+
+		std::string file = files.front();
+		if (!std::filesystem::exists(config::torrents_dir() / file)) {
+			logger::info(name) << "Torrent file \"" << file << "\" of \"" << name << "\" does not exist.";
+			forget_file(file);
+			continue;
+		}
+
+		{
+			torrent_userdata *userdata = seeding_torrents.find(name);
+
+			// Trackers count partial seeders as leechers
+			uint32_t own_seeders = userdata && userdata->partial_share == 0 ? 1 : 0;
+			if (torrent.number_of_seeders >= config::min_seeders_to_ignore() + own_seeders) {
+				// If torrent should not be seeding
+				if (userdata) {
+					// And if torrent is already seeding
+					logger::info(name) << "Stopping seeding of \"" << name << "\" with " << torrent.number_of_seeders << " seeders.";
+					stop_seeding(*userdata);
+					logger::info() << "Total number of torrents seeding is " << seeding_torrents.size() << ".";
+				}
+
+				continue;
+			} else {
+				// If torrent should be seeding
+				if (userdata) {
+					// And it is already seeding. A partial seeder takes the rest of the pieces as soon as they fit.
+					bool added = userdata->handle.is_valid() && userdata->handle.in_session();
+					if (userdata->partial_share != 0 && added && torrent.data_size != 0
+							&& ledger::total() - ledger::get(name) + torrent.data_size <= config::max_data_size()) {
+						logger::info(name) << "Seeding all pieces of \"" << name << "\", because the rest of its data fits now.";
+						seed_all_pieces(*userdata, torrent.data_size);
+					}
+					continue;
+				}
+			}
+		}
+
+		// Old data must be gone before the torrent can be downloaded again
+		if (deletion::pending(name))
+			continue;
+
+		// Parsing happens on the loader's threads. The torrent is started by the update that follows once every requested load has finished.
+		auto prepared = prepared_torrents.find(name);
+		if (prepared == prepared_torrents.end()) {
+			if (loading_torrents.insert(name).second)
+				loader::request(file, name, loader::purpose::prepare);
+			continue;
+		}
+
+		uint64_t data_size = prepared->second.ti->total_size();
+		if (torrent.data_size != data_size) {
+			stats::torrent updated = torrent;
+			updated.data_size = data_size;
+			stats::set(id, updated);
+		}
+
+		uint64_t bytes_stored = std::min(data_size, ledger::get(name)); // Part of the data might already be on disk
+		uint64_t bytes_to_download = data_size - bytes_stored;
+		uint64_t partial_share = 0;
+
+		if (ledger::total() + bytes_to_download > config::max_data_size()) {
+			// Data that is already being deleted does not have to be freed again
+			uint64_t bytes_kept = ledger::total() - ledger::deleting_total();
+			if (bytes_kept + bytes_to_download <= config::max_data_size()) {
+				logger::debug(name) << "Waiting for deleted data to free enough space for \"" << name << "\".";
+				continue;
+			}
+
+			// Attempt to purge less important torrent data if the size of this torrent would make the data directory too large
+			logger::warning(name) << "Unable to start seeding \"" << name << "\", because the data directory is too large. Attempting to free some space.";
+
+			std::vector<std::string> evicted_names;
+			bool evicting = ledger::plan_eviction(bytes_kept + bytes_to_download - config::max_data_size(), torrent, name, evicted_names);
+
+			// The rarest part of a torrent that does not fit as a whole still keeps its swarm complete
+			if (!evicting && config::min_partial_size() != 0) {
+				uint64_t bytes_free = config::max_data_size() - std::min(config::max_data_size(), bytes_kept);
+				uint64_t min_share = std::min(data_size, config::min_partial_size());
+				if (bytes_stored + bytes_free >= min_share)
+					partial_share = bytes_stored + bytes_free;
+				else
+					evicting = ledger::plan_eviction(min_share - bytes_stored - bytes_free, torrent, name, evicted_names);
+			}
+
+			if (partial_share == 0) {
+				if (!evicting) {
+					logger::info() << "Could not find enough bytes of less important data to free. The torrent will not be seeded.";
+					logger::info(name) << "Unregistering \"" << name << "\".";
+					unregister_torrent(name);
+					continue;
+				}
+
+				logger::info() << "Found enough bytes of less important data to free. Purging.";
+				for (const std::string &evicted_name : evicted_names) {
+					if (torrent_userdata *userdata = seeding_torrents.find(evicted_name)) {
+						logger::info(evicted_name) << "Stopping seeding of \"" << evicted_name << "\".";
+						stop_seeding(*userdata);
+					}
+
+					logger::info(evicted_name) << "Queueing deletion of all data belonging to \"" << evicted_name << "\".";
+					delete_data(evicted_name);
+				}
+
+				// The torrent is started once the deletions have finished
+				continue;
+			}
+
+			if (ledger::total() - bytes_stored + partial_share > config::max_data_size()) {
+				logger::debug(name) << "Waiting for deleted data to free enough space for part of \"" << name << "\".";
+				continue;
+			}
+
+			logger::info(name) << "Only " << (partial_share / 1024.0F / 1024.0F / 1024.0F) << " GiB of \"" << name << "\" fit. Seeding its rarest pieces.";
+		}
+
+		lt::add_torrent_params params = std::move(prepared->second);
+		prepared_torrents.erase(prepared);
+
+		// Priorities saved with the resume data are left over from seeding only part of the torrent
+		params.piece_priorities.clear();
+		params.file_priorities.clear();
+		if (partial_share != 0)
+			params.flags |= lt::torrent_flags::upload_mode; // Nothing is downloaded until the pieces have been chosen
+		else
+			params.flags &= ~lt::torrent_flags::upload_mode;
+
+		logger::info(name) << "Attempting to start seeding of \"" << name << "\" with " << torrent.number_of_seeders << " seeders.";
+
+		torrent_userdata &userdata = seeding_torrents.insert(name, true, params.ti->info_hashes().get_best());
+		userdata.add_time = util::seconds_since_epoch();
+		userdata.sample_time = userdata.add_time;
+		userdata.partial_share = partial_share;
+
+		// Reserve the full size, or the share of a partial seeder, until the download has finished and the actual size can be measured
+		ledger::set(name, std::max(partial_share != 0 ? partial_share : data_size, ledger::get(name)));
+		if (partial_share != 0)
+			selecting_torrents[name] = userdata.add_time + partial::selection_delay;
+
+		params.userdata = &userdata;
+
+		// Until allocate_upload has given the torrent its share, it must not take the share of the others
+		if (config::max_upload_rate() != 0)
+			params.upload_limit = static_cast<int>(bandwidth::min_rate);
+
+		session_of(userdata.info_hash).async_add_torrent(std::move(params));
+	}
+
+	// Torrents that no longer need to be seeded are loaded again if they do
+	prepared_torrents.clear();
+}
+
+void select_pieces_of_partial_torrents() {
+	uint64_t now = util::seconds_since_epoch();
+
+	std::vector<std::string> selected_names;
+	for (auto &[name, selection_time] : selecting_torrents) {
+		if (selection_time > now)
+			continue;
+
+		// The torrent might not have been added to its session yet
+		torrent_userdata *userdata = seeding_torrents.find(name);
+		std::shared_ptr<const lt::torrent_info> info = userdata->handle.is_valid() && userdata->handle.in_session() ? userdata->handle.torrent_file() : nullptr;
+		if (!info) {
+			selection_time = now + partial::selection_delay;
+			continue;
+		}
+
+		lt::torrent_status status = userdata->handle.status(lt::torrent_handle::query_pieces);
+		std::vector<int> availability;
+		userdata->handle.piece_availability(availability);
+
+		std::vector<lt::download_priority_t> priorities;
+		uint64_t bytes_selected = partial::select_pieces(*info, status.pieces, availability, userdata->partial_share, priorities);
+
+		// Without peers there is nothing to choose from yet
+		if (status.num_peers == 0 && bytes_selected <= static_cast<uint64_t>(status.total_done)) {
+			selection_time = now + partial::selection_delay;
+			continue;
+		}
+
+		logger::info(name) << "Chose " << (bytes_selected / 1024.0F / 1024.0F / 1024.0F) << " GiB of the rarest pieces of \"" << name << "\" to seed.";
+		userdata->handle.prioritize_pieces(priorities);
+		userdata->handle.unset_flags(lt::torrent_flags::upload_mode);
+
+		// Only what has been chosen is going to be stored
+		ledger::set(name, bytes_selected);
+		selected_names.push_back(name);
+	}
+
+	for (const std::string &name : selected_names)
+		selecting_torrents.erase(name);
+}
+
+void save_resume_data_of_seeding_torrents(lt::resume_data_flags_t flags) {
+	logger::debug() << "Saving resume data of seeding torrents.";
+
+	for (torrent_userdata *userdata : seeding_torrents) {
+		if (!userdata->handle.is_valid() || !userdata->handle.in_session())
+			continue;
+
+		userdata->handle.save_resume_data(flags);
+		resume_saves_outstanding++; // Every request is answered by exactly one alert, either with the data or with a failure
+	}
+
+	last_resume_save_time = util::seconds_since_epoch();
+}
+
+void save_session_states() {
+	logger::debug() << "Saving the state of the sessions.";
+
+	for (uint32_t i = 0; i < sessions.size(); i++) {
+		try {
+			resume::save_session(i, sessions[i]->session_state(lt::session::save_dht_state));
+		} catch (std::exception &e) {
+			logger::warning() << "Unable to save the state of session " << i << ": " << e.what();
+		}
+	}
+
+	last_session_state_save_time = util::seconds_since_epoch();
+}
+
+void sample_upload_of_seeding_torrents() {
+	logger::debug() << "Sampling upload of seeding torrents.";
+
+	for (torrent_userdata *userdata : seeding_torrents)
+		sample_upload(*userdata);
+
+	// Only the payload counters are needed, and only torrents whose status has changed are reported
+	for (auto &session : sessions)
+		session->post_torrent_updates({});
+
+	last_upload_sample_time = util::seconds_since_epoch();
+}
+
+void enforce_memory_budget() {
+	metrics::set("btup_resident_memory_bytes", "", static_cast<double>(profile::resident_memory()));
+
+	lt::settings_pack settings;
+	if (profile::enforce(settings))
+		for (auto &session : sessions)
+			session->apply_settings(settings);
+
+	last_memory_check_time = util::seconds_since_epoch();
+}
+
+void scrape_recounting_torrent(torrent_userdata &userdata, const std::string &tracker) {
+	userdata.tracker = tracker;
+	userdata.scrape_sent = false;
+	userdata.add_time = util::seconds_since_epoch();
+	userdata.timeout = recount_timeout; // Until the scrape is sent, which starts the tracker's own timeout
+	scrape::request(tracker, userdata.info_hash);
+}
+
+bool fail_over_recounting_torrent(torrent_userdata &userdata) {
+	while (!userdata.fallback_trackers.empty()) {
+		std::string tracker = std::move(userdata.fallback_trackers.back());
+		userdata.fallback_trackers.pop_back();
+
+		// Skip trackers that have started backing off since the recount started
+		if (!health::is_available(tracker, util::seconds_since_epoch()))
+			continue;
+
+		logger::info(userdata.name) << "Scraping \"" << userdata.name << "\" from " << tracker << " instead.";
+		scrape_recounting_torrent(userdata, tracker);
+		return true;
+	}
+
+	logger::info(userdata.name) << "Looking up \"" << userdata.name << "\" in the DHT instead.";
+	look_up_recounting_torrent_in_dht(userdata);
+	return false;
+}
+
+void look_up_recounting_torrent_in_dht(torrent_userdata &userdata) {
+	userdata.tracker.clear();
+	userdata.fallback_trackers.clear();
+	userdata.add_time = util::seconds_since_epoch();
+	userdata.timeout = recount_timeout;
+	session_of(userdata.info_hash).dht_get_peers(userdata.info_hash);
+}
+
+void record_tracker_failure(const std::string &tracker, uint64_t now) {
+	if (health::record_failure(tracker, now)) {
+		metrics::add("btup_tracker_back_offs_total");
+		logger::warning() << "Tracker " << tracker << " failed " << health::failures_to_back_off << " times in a row. Skipping it for a while.";
+	}
+}
+
+void finish_timed_out_recounting_tickets() {
+	logger::debug() << "Finalizing recounting tickets that have timed out.";
+
+	uint64_t now = util::seconds_since_epoch();
+	std::vector<torrent_userdata *> timed_out;
+	for (torrent_userdata *userdata : recounting_torrents) {
+		if (now - userdata->add_time > userdata->timeout)
+			timed_out.push_back(userdata);
+	}
+
+	// Torrents scraped in the same request time out together, but only count as a single failure of their tracker
+	std::unordered_set<std::string> failed_trackers;
+	bool any_scrape_requested = false;
+	for (torrent_userdata *userdata : timed_out) {
+		if (!userdata->tracker.empty()) {
+			metrics::add("btup_recount_timeouts_total", "source=\"tracker\"");
+			if (userdata->scrape_sent) {
+				logger::info(userdata->name) << "Tracker " << userdata->tracker << " did not respond to the scrape of \"" << userdata->name << "\" in time.";
+				if (failed_trackers.insert(userdata->tracker).second)
+					record_tracker_failure(userdata->tracker, now);
+			} else // The tracker was never asked, so it is not to blame
+				logger::info(userdata->name) << "Scrape of \"" << userdata->name << "\" was still queued for " << userdata->tracker << " when its recount timed out.";
+			any_scrape_requested = fail_over_recounting_torrent(*userdata) || any_scrape_requested;
+			continue;
+		}
+
+		// The DHT does not tell seeders apart, so the number of peers is only an upper bound on the number of seeders.
+		// It can show that a swarm needs seeders, but never that it has enough, so it is capped below the number that stops seeding.
+		uint32_t number_of_peers = userdata->dht_peers.size();
+		uint32_t max_number_of_seeders = config::min_seeders_to_ignore() > 0 ? config::min_seeders_to_ignore() - 1 : 0;
+		uint32_t number_of_seeders = std::min(number_of_peers, max_number_of_seeders);
+		logger::info(userdata->name) << "Torrent \"" << userdata->name << "\" did not receive a response from the tracker. Found " << number_of_peers << " peer" << (number_of_peers == 1 ? "" : "s") << " in the DHT, counting them as at most " << number_of_seeders << " seeder" << (number_of_seeders == 1 ? "." : "s.");
+		record_recount(userdata->name, number_of_seeders);
+		metrics::add("btup_recounts_total", "source=\"dht\"");
+
+		recounting_torrents.erase(*userdata);
+	}
+
+	if (any_scrape_requested)
+		scrape::flush();
+}
+
+void start_recounting_seeders() {
+	logger::debug() << "Starting to recount torrents."; 
+
+	stats::torrent_id id;
+	while (recounting_torrents.size() + loading_recounts.size() < config::max_parallel_recounts() && scheduler::pop_due(util::seconds_since_epoch(), id)) {
+		if (!stats::contains(id)) // If torrent is gone
+			continue;
+
+		std::string name = stats::name_of(id);
+		if (recounting_torrents.find(name) || loading_recounts.contains(name)) // If torrent is already being recounted
+			continue;
+
+		// Wait for the torrent to be identified again or unregistered
+		const std::vector<std::string> &files = stats::files_of(name);
+		std::filesystem::path torrent_path = files.empty() ? std::filesystem::path() : config::torrents_dir() / files.front();
+		if (files.empty() || !std::filesystem::exists(torrent_path)) {
+			if (!files.empty()) {
+				std::string file = files.front();
+				logger::info(name) << "Torrent file \"" << file << "\" of \"" << name << "\" does not exist.";
+				forget_file(file);
+			}
+			scheduler::schedule(id, util::seconds_since_epoch(), stats::get(id).recount_interval);
+			continue;
+		}
+		
+		// The trackers are read from the file on the loader's threads, because it has most likely dropped out of the metainfo cache since the last recount
+		loading_recounts.insert(name);
+		loader::request(files.front(), name, loader::purpose::recount);
+	}
+}
+
+bool recount_seeders(const std::string &name, const lt::sha1_hash &info_hash, const std::vector<std::string> &announce_urls) {
+	logger::info(name) << "Recounting seeders for \"" << name << "\".";
+
+	torrent_userdata &userdata = recounting_torrents.insert(name, false, info_hash);
+
+	// Trackers know the exact number of seeders, so the DHT is only asked if none of them can be scraped. Trackers that keep failing are not asked at all.
+	std::vector<std::string> trackers;
+	for (const std::string &url : announce_urls) {
+		if (scrape::is_scrapable(url) && health::is_available(url, util::seconds_since_epoch()) && std::find(trackers.begin(), trackers.end(), url) == trackers.end())
+			trackers.push_back(url);
+	}
+	health::sort(trackers);
+	trackers.resize(std::min(trackers.size(), max_trackers_per_recount));
+
+	if (trackers.empty()) {
+		look_up_recounting_torrent_in_dht(userdata);
+		return false;
+	}
+
+	userdata.fallback_trackers.assign(trackers.rbegin(), trackers.rend() - 1);
+	scrape_recounting_torrent(userdata, trackers.front());
+	return true;
+}
+
+void process_scrape_results() {
+	logger::debug() << "Processing scrape results.";
+
+	uint64_t now = util::seconds_since_epoch();
+
+	// Start the tracker's timeout once the scrape has actually been sent
+	std::vector<scrape::sent_request> sent;
+	scrape::pop_sent(sent);
+	for (const scrape::sent_request &request : sent) {
+		torrent_userdata *userdata = recounting_torrents.find(request.info_hash);
+		if (!userdata || userdata->tracker != request.tracker || userdata->scrape_sent)
+			continue;
+
+		userdata->scrape_sent = true;
+		userdata->add_time = now;
+		userdata->timeout = health::timeout_of(request.tracker, recount_timeout);
+	}
+
+	std::vector<scrape::result> results;
+	scrape::pop_results(results);
+
+	// Every request answers several torrents, but only counts once towards the health of its tracker. Late replies count too, so that timeouts adapt to slow trackers.
+	// Failures only count while the recount still waits for the tracker. Otherwise it has already been counted when the recount timed out.
+	std::unordered_map<std::string, double> latencies;
+	std::unordered_set<std::string> failed_trackers;
+	for (const scrape::result &result : results) {
+		if (result.latency >= 0) {
+			auto [it, inserted] = latencies.emplace(result.tracker, result.latency);
+			if (!inserted)
+				it->second = std::max(it->second, result.latency);
+			continue;
+		}
+
+		torrent_userdata *userdata = recounting_torrents.find(result.info_hash);
+		if (userdata && userdata->tracker == result.tracker)
+			failed_trackers.insert(result.tracker);
+	}
+	for (const auto &[tracker, latency] : latencies)
+		health::record_success(tracker, latency);
+	for (const std::string &tracker : failed_trackers)
+		record_tracker_failure(tracker, now);
+
+	bool any_scrape_requested = false;
+	for (const scrape::result &result : results) {
+		torrent_userdata *userdata = recounting_torrents.find(result.info_hash);
+		if (!userdata || userdata->tracker != result.tracker) // If the recount has already timed out
+			continue;
+
+		if (!result.success || result.complete < 0) {
+			metrics::add("btup_scrape_failures_total");
+			logger::info(userdata->name) << "Tracker " << result.tracker << " did not return the number of seeders of \"" << userdata->name << "\".";
+			any_scrape_requested = fail_over_recounting_torrent(*userdata) || any_scrape_requested;
+			continue;
+		}
+
+		uint64_t elapsed = util::seconds_since_epoch() - userdata->add_time;
+		metrics::observe("btup_scrape_latency_seconds", "", result.latency);
+		uint32_t number_of_seeders = static_cast<uint32_t>(result.complete);
+		logger::info(userdata->name) << "Received scrape reply for \"" << userdata->name << "\" after " << elapsed << " second" << (elapsed == 1 ? "." : "s.");
+		logger::info(userdata->name) << "Tracker knows " << number_of_seeders << " seeder" << (number_of_seeders == 1 ? "" : "s") << " of \"" << userdata->name << "\".";
+
+		record_recount(userdata->name, number_of_seeders, result.incomplete, result.downloaded);
+		metrics::add("btup_recounts_total", "source=\"tracker\"");
+		recounting_torrents.erase(*userdata);
+	}
+
+	if (any_scrape_requested)
+		scrape::flush();
+}
+
+void process_loaded_torrents() {
+	logger::debug() << "Processing loaded torrents.";
+
+	std::vector<loader::result> results;
+	loader::pop_results(results);
+
+	bool any_prepared = false;
+	bool any_identified = false;
+	bool any_scrape_requested = false;
+	for (loader::result &result : results) {
+		if (result.purpose == loader::purpose::recount) {
+			loading_recounts.erase(result.name);
+
+			stats::torrent_id id = stats::find(result.name);
+			if (id == stats::no_id) // If torrent is gone
+				continue;
+
+			// The file was rewritten or truncated since it was identified. Identify it again, and recount the torrent once it has a file again.
+			if (!result.error.empty()) {
+				logger::warning(result.name) << "Unable to load \"" << result.file << "\" for a recount: " << result.error;
+				forget_file(result.file);
+				if (std::filesystem::exists(config::torrents_dir() / result.file))
+					discover_file(result.file);
+				scheduler::schedule(id, util::seconds_since_epoch(), stats::get(id).recount_interval);
+				continue;
+			}
+
+			any_scrape_requested = recount_seeders(result.name, result.info_hash, result.trackers) || any_scrape_requested;
+			continue;
+		}
+
+		if (result.purpose == loader::purpose::prepare) {
+			loading_torrents.erase(result.name);
+
+			if (!result.error.empty()) {
+				logger::warning(result.name) << "Unable to load \"" << result.file << "\": " << result.error;
+				continue;
+			}
+
+			prepared_torrents[result.name] = std::move(result.params);
+			any_prepared = true;
+			continue;
+		}
+
+		// Files that are gone have been forgotten while they were parsed, and files that were written again are parsed again
+		auto identifying = identifying_files.find(result.file);
+		if (identifying == identifying_files.end() || identifying->second != result.generation)
+			continue;
+		identifying_files.erase(identifying);
+
+		if (!result.error.empty()) {
+			logger::warning() << "Unable to load \"" << result.file << "\": " << result.error;
+			continue;
+		}
+
+		identify_file(result.file, result.name);
+		any_identified = true;
+	}
+
+	// Waiting for every load lets the update start the torrents in the order of their scores
+	if (any_prepared && loading_torrents.empty())
+		last_update_time = 0;
+
+	// Torrents without files and data without torrents are only cleaned up once every file has been identified
+	if (any_identified && identifying_files.empty())
+		last_update_time = 0;
+
+	if (any_scrape_requested)
+		scrape::flush();
+}
+
+void process_finished_deletions() {
+	logger::debug() << "Processing finished deletions.";
+
+	std::vector<std::string> names;
+	deletion::pop_finished(names);
+
+	for (const std::string &name : names) {
+		logger::info(name) << "Deleted all data belonging to \"" << name << "\".";
+		ledger::remove(name);
+	}
+
+	// Torrents that were waiting for space might fit now
+	if (!names.empty())
+		last_update_time = 0;
+}
+
+torrent_userdata *find_userdata(const lt::torrent_handle &handle) {
+	if (torrent_userdata *userdata = seeding_torrents.find(handle))
+		return userdata;
+
+	// Handles are only known once the torrent has been added, so fall back to the info-hash
+	if (torrent_userdata *userdata = seeding_torrents.find(handle.info_hashes().get_best())) {
+		seeding_torrents.bind(*userdata, handle);
+		return userdata;
+	}
+	return nullptr;
+}
+
+void process_libtorrent_alerts() {
+	logger::debug() << "Processing LibTorrent alerts.";
+
+	// Process LibTorrent alerts for recounting and seeding
+	std::vector<lt::alert *> alerts;
+	for (auto &session : sessions) {
+		// Alerts stay valid until the same session is asked for alerts again
+		std::vector<lt::alert *> session_alerts;
+		session->pop_alerts(&session_alerts);
+		alerts.insert(alerts.end(), session_alerts.begin(), session_alerts.end());
+	}
+	metrics::set(*loop_metrics.alert_queue_depth, static_cast<double>(alerts.size()));
+	metrics::add(*loop_metrics.alerts, static_cast<double>(alerts.size()));
+
+	for (lt::alert *alert : alerts) {
+		// logger::debug() << "Received LibTorrent alert: " << alert->message();
+
+		if (auto *dht_get_peers_reply_alert = lt::alert_cast<lt::dht_get_peers_reply_alert>(alert)) {
+			torrent_userdata *userdata = recounting_torrents.find(dht_get_peers_reply_alert->info_hash);
+			if (!userdata || !userdata->tracker.empty()) // If the recount has already finished
+				continue;
+
+			for (const auto &peer : dht_get_peers_reply_alert->peers())
+				userdata->dht_peers.insert(peer);
+		} else if (auto *state_update_alert = lt::alert_cast<lt::state_update_alert>(alert)) {
+			for (const lt::torrent_status &status : state_update_alert->status) {
+				if (torrent_userdata *userdata = find_userdata(status.handle))
+					userdata->total_upload = status.total_payload_upload;
+			}
+		} else if (auto *torrent_alert = dynamic_cast<lt::torrent_alert *>(alert)) {
+			if (lt::alert_cast<lt::save_resume_data_alert>(alert) || lt::alert_cast<lt::save_resume_data_failed_alert>(alert))
+				resume_saves_outstanding--;
+
+			if (!torrent_alert->handle.is_valid() || !torrent_alert->handle.in_session())
+				continue;
+
+			torrent_userdata *userdata = find_userdata(torrent_alert->handle);
+			if (!userdata) {
+				session_of(torrent_alert->handle.info_hashes().get_best()).remove_torrent(torrent_alert->handle);
+				continue;
+			}
+
+			if (lt::alert_cast<lt::add_torrent_alert>(torrent_alert)) {
+				stats::torrent_id id = stats::find(userdata->name);
+				if (id != stats::no_id && stats::get(id).number_of_seeders == 0 && userdata->handle.status().state != lt::torrent_status::state_t::seeding) {
+					logger::info(userdata->name) << "Torrent \"" << userdata->name << "\" has no seeders at all and a local copy of torrent's data is not available. Unable to start seeding this torrent.";
+					logger::info(userdata->name) << "Unregistering \"" << userdata->name << "\".";
+					unregister_torrent(userdata->name);
+					stop_seeding(*userdata);
+				} else {
+					logger::info(userdata->name) << "Successfully started seeding \"" << userdata->name << "\".";
+					if (userdata->upload_limit != 0)
+						apply_upload_limit(*userdata);
+				}
+
+				logger::info() << "Total number of torrents seeding is " << seeding_torrents.size() << ".";
+			} else if (lt::alert_cast<lt::torrent_finished_alert>(torrent_alert)) {
+				// The download is complete, so the reservation can be replaced by what is actually on disk
+				ledger::set(userdata->name, ledger::measure(config::data_dir() / userdata->name));
+			} else if (auto *save_resume_data_alert = lt::alert_cast<lt::save_resume_data_alert>(torrent_alert)) {
+				try {
+					resume::save(userdata->name, save_resume_data_alert->params);
+				} catch (std::exception &e) {
+					logger::warning(userdata->name) << "Unable to save resume data of \"" << userdata->name << "\": " << e.what();
+				}
+			} else if (auto *save_resume_data_failed_alert = lt::alert_cast<lt::save_resume_data_failed_alert>(torrent_alert)) {
+				// Torrents that have not changed since the last save are reported here too
+				logger::debug(userdata->name) << "Resume data of \"" << userdata->name << "\" was not saved: " << save_resume_data_failed_alert->error.message();
+			}
+		}
+	}
+}
+
+uint64_t next_deadline() {
+	uint64_t deadline = last_update_time + config::update_delay() + 1;
+
+	for (const torrent_userdata *userdata : recounting_torrents)
+		deadline = std::min(deadline, userdata->add_time + userdata->timeout + 1);
+
+	// Finished or timed out recounts wake the main loop by themselves when there are no free slots
+	if (recounting_torrents.size() + loading_recounts.size() < config::max_parallel_recounts())
+		deadline = std::min(deadline, scheduler::next_due_time());
+
+	deadline = std::min(deadline, stats::next_save_time());
+	deadline = std::min(deadline, last_resume_save_time + resume_save_interval + 1);
+	deadline = std::min(deadline, last_session_state_save_time + session_state_save_interval + 1);
+	deadline = std::min(deadline, last_upload_sample_time + upload_sample_interval + 1);
+	deadline = std::min(deadline, last_memory_check_time + memory_check_interval + 1);
+
+	for (const auto &[name, selection_time] : selecting_torrents)
+		deadline = std::min(deadline, selection_time);
+	return deadline;
+}
+
+void run_update() {
+	logger::debug() << "Periodic process update has started.";
+
+	metrics::time(loop_metrics.discover_new_torrents_and_unregister_deleted_ones, discover_new_torrents_and_unregister_deleted_ones);
+
+	std::vector<stats::torrent_id> torrent_ids;
+	metrics::time(loop_metrics.get_torrent_ids_from_stats, [&]() {
+		get_torrent_ids_from_stats(torrent_ids);
+	});
+
+	metrics::time(loop_metrics.purge_data_of_deleted_torrents, purge_data_of_deleted_torrents);
+
+	metrics::time(loop_metrics.sort_torrent_ids_by_score, [&]() {
+		sort_torrent_ids_by_score(torrent_ids);
+	});
+
+	metrics::time(loop_metrics.manage_torrent_seeding, [&]() {
+		manage_torrent_seeding(torrent_ids);
+	});
+
+	metrics::time(loop_metrics.allocate_upload, allocate_upload);
+	
+	last_update_time = util::seconds_since_epoch();
+}
+
+void describe_metrics() {
+	metrics::describe("btup_step_duration_seconds", metrics::metric_type::histogram, "Time spent in each step of the main loop.");
+	metrics::describe("btup_scrape_latency_seconds", metrics::metric_type::histogram, "Time from sending a scrape request to the tracker's reply.");
+	metrics::describe("btup_scrape_failures_total", metrics::metric_type::counter, "Scrapes that failed or did not return the number of seeders.");
+	metrics::describe("btup_tracker_back_offs_total", metrics::metric_type::counter, "Trackers that failed too often in a row and are skipped for a while.");
+	metrics::describe("btup_recount_timeouts_total", metrics::metric_type::counter, "Recounts that timed out, by the source that did not answer.");
+	metrics::describe("btup_recounts_total", metrics::metric_type::counter, "Finished recounts, by the source of the seeder count.");
+	metrics::describe("btup_alerts_total", metrics::metric_type::counter, "LibTorrent alerts processed.");
+	metrics::describe("btup_alert_queue_depth", metrics::metric_type::gauge, "LibTorrent alerts popped at once by the last iteration of the main loop.");
+	metrics::describe("btup_torrents", metrics::metric_type::gauge, "Torrents by state.");
+	metrics::describe("btup_resident_memory_bytes", metrics::metric_type::gauge, "Resident memory of the process.");
+	metrics::describe("btup_data_bytes", metrics::metric_type::gauge, "Bytes the data directory takes up on disk, including data pending deletion.");
+	metrics::describe("btup_data_pending_deletion_bytes", metrics::metric_type::gauge, "Bytes of data queued for deletion.");
+	metrics::describe("btup_uploaded_bytes_total", metrics::metric_type::counter, "Payload uploaded by seeding torrents, counted when it is sampled.");
+	metrics::describe("btup_metainfo_cache_bytes", metrics::metric_type::gauge, "Estimated memory usage of the metainfo cache.");
+
+	// Resolving the series up front keeps labels and the registry lock out of the main loop
+	auto step = [](const char *name) {
+		return &metrics::find("btup_step_duration_seconds", std::string("step=\"") + name + "\"");
+	};
+	loop_metrics.run_update = step("run_update");
+	loop_metrics.finish_timed_out_recounting_tickets = step("finish_timed_out_recounting_tickets");
+	loop_metrics.start_recounting_seeders = step("start_recounting_seeders");
+	loop_metrics.select_pieces_of_partial_torrents = step("select_pieces_of_partial_torrents");
+	loop_metrics.process_libtorrent_alerts = step("process_libtorrent_alerts");
+	loop_metrics.process_scrape_results = step("process_scrape_results");
+	loop_metrics.process_loaded_torrents = step("process_loaded_torrents");
+	loop_metrics.process_finished_deletions = step("process_finished_deletions");
+	loop_metrics.stats_try_save = step("stats_try_save");
+	loop_metrics.deletion_try_save = step("deletion_try_save");
+	loop_metrics.save_session_states = step("save_session_states");
+	loop_metrics.sample_upload_of_seeding_torrents = step("sample_upload_of_seeding_torrents");
+	loop_metrics.discover_new_torrents_and_unregister_deleted_ones = step("discover_new_torrents_and_unregister_deleted_ones");
+	loop_metrics.get_torrent_ids_from_stats = step("get_torrent_ids_from_stats");
+	loop_metrics.purge_data_of_deleted_torrents = step("purge_data_of_deleted_torrents");
+	loop_metrics.sort_torrent_ids_by_score = step("sort_torrent_ids_by_score");
+	loop_metrics.manage_torrent_seeding = step("manage_torrent_seeding");
+	loop_metrics.allocate_upload = step("allocate_upload");
+	loop_metrics.enforce_memory_budget = step("enforce_memory_budget");
+	loop_metrics.alerts = &metrics::find("btup_alerts_total");
+	loop_metrics.alert_queue_depth = &metrics::find("btup_alert_queue_depth");
+}
+
+void update_gauges() {
+	metrics::set("btup_torrents", "state=\"registered\"", static_cast<double>(stats::size()));
+	metrics::set("btup_torrents", "state=\"seeding\"", static_cast<double>(seeding_torrents.size()));
+	metrics::set("btup_torrents", "state=\"recounting\"", static_cast<double>(recounting_torrents.size()));
+	metrics::set("btup_torrents", "state=\"loading\"", static_cast<double>(loading_torrents.size()));
+	metrics::set("btup_data_bytes", "", static_cast<double>(ledger::total()));
+	metrics::set("btup_data_pending_deletion_bytes", "", static_cast<double>(ledger::deleting_total()));
+	metrics::set("btup_metainfo_cache_bytes", "", static_cast<double>(metainfo::memory_usage()));
+}
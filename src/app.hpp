@@ -0,0 +1,180 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <libtorrent/session.hpp>
+
+#include <registry.hpp>
+#include <stats.hpp>
+
+// Everything the main loop does, kept apart from main so that the benchmark can drive it step by step
+
+namespace metrics {
+	struct series;
+}
+
+// Series the main loop updates on every iteration, resolved once by describe_metrics. Steps are series of btup_step_duration_seconds.
+struct loop_series {
+	metrics::series *run_update;
+	metrics::series *finish_timed_out_recounting_tickets;
+	metrics::series *start_recounting_seeders;
+	metrics::series *select_pieces_of_partial_torrents;
+	metrics::series *process_libtorrent_alerts;
+	metrics::series *process_scrape_results;
+	metrics::series *process_loaded_torrents;
+	metrics::series *process_finished_deletions;
+	metrics::series *stats_try_save;
+	metrics::series *deletion_try_save;
+	metrics::series *save_session_states;
+	metrics::series *sample_upload_of_seeding_torrents;
+	metrics::series *discover_new_torrents_and_unregister_deleted_ones;
+	metrics::series *get_torrent_ids_from_stats;
+	metrics::series *purge_data_of_deleted_torrents;
+	metrics::series *sort_torrent_ids_by_score;
+	metrics::series *manage_torrent_seeding;
+	metrics::series *allocate_upload;
+	metrics::series *enforce_memory_budget;
+	metrics::series *alerts;
+	metrics::series *alert_queue_depth;
+};
+
+// Creates the configured number of sessions. The main thread stays the only coordinator, so the data size limit and the seeding order hold across all of them.
+void start_sessions(lt::settings_pack settings);
+
+// Returns the session that owns the torrent
+lt::session &session_of(const lt::sha1_hash &info_hash);
+
+void register_torrent(const std::string &name);
+
+// Forgets the statistics of a torrent. If one of its files still exists, it starts over as if it was just discovered.
+void unregister_torrent(const std::string &name);
+
+// Has the loader find out which torrent a new file describes
+void discover_file(const std::string &file);
+
+// Unlinks a file that is gone. Its torrent is kept until unregister_torrents_without_files runs, so that renamed files keep their history.
+void forget_file(const std::string &file);
+
+// Links a parsed file to its torrent. Renamed and duplicate files of a registered torrent reuse its statistics and data.
+void identify_file(const std::string &file, const std::string &name);
+
+// Moves statistics, data and resume data to a new name
+void migrate_torrent(const std::string &from, const std::string &to);
+
+// Unregisters torrents whose last file has gone, once no file is left to identify
+void unregister_torrents_without_files();
+
+// Leechers and downloads of -1 are unknown and keep the values of the previous recount
+void record_recount(const std::string &name, uint32_t number_of_seeders, int32_t number_of_leechers = -1, int32_t number_of_downloads = -1);
+
+void rescan_torrents_dir();
+
+void discover_new_torrents_and_unregister_deleted_ones();
+
+void get_torrent_ids_from_stats(std::vector<stats::torrent_id> &ids);
+
+void sort_torrent_ids_by_score(std::vector<stats::torrent_id> &ids);
+
+// The data keeps counting towards the ledger's total until the deletion worker is done with it
+void delete_data(const std::string &name);
+
+void purge_data_of_deleted_torrents();
+
+// Folds the payload uploaded since the last sample into the torrent's statistics
+void sample_upload(torrent_userdata &userdata);
+
+void stop_seeding(torrent_userdata &userdata);
+
+// Splits the configured uplink between the seeding torrents by how much their swarms depend on us, and limits their upload and unchoke slots to match
+void allocate_upload();
+
+// Limits the torrent to the upload allocate_upload has chosen for it, along with the unchoke slots and connections that upload pays for
+void apply_upload_limit(torrent_userdata &userdata);
+
+// Has a partially seeded torrent download all of its pieces
+void seed_all_pieces(torrent_userdata &userdata, uint64_t data_size);
+
+void manage_torrent_seeding(const std::vector<stats::torrent_id> &torrent_ids);
+
+// Chooses the pieces of partially seeded torrents once their peers have reported which pieces they have
+void select_pieces_of_partial_torrents();
+
+void save_resume_data_of_seeding_torrents(lt::resume_data_flags_t flags);
+
+// Saves the DHT routing table of every session, which start_sessions restores
+void save_session_states();
+
+// Samples the upload of every seeding torrent and asks the sessions for fresh totals, which arrive with the next state update alerts
+void sample_upload_of_seeding_torrents();
+
+// Measures the resident memory and keeps it within the memory budget by lowering or restoring the connection limit of every session
+void enforce_memory_budget();
+
+// Asks the tracker for the number of seeders, waiting for it about as long as it usually takes to answer
+void scrape_recounting_torrent(torrent_userdata &userdata, const std::string &tracker);
+
+// Scrapes the next tracker of a recount whose tracker failed, or looks the torrent up in the DHT once no tracker is left. Returns true if a scrape has been queued.
+bool fail_over_recounting_torrent(torrent_userdata &userdata);
+
+// Recounts a torrent that has no working tracker by collecting the peers the DHT knows of. This touches neither the disk nor the session's torrent list.
+void look_up_recounting_torrent_in_dht(torrent_userdata &userdata);
+
+// Counts a scrape request that failed or timed out against its tracker
+void record_tracker_failure(const std::string &tracker, uint64_t now);
+
+void finish_timed_out_recounting_tickets();
+
+// Pops torrents that are due for a recount and has the loader read their trackers. The recounts start in process_loaded_torrents.
+void start_recounting_seeders();
+
+// Starts the recount of a loaded torrent. Returns true if a scrape was requested and the scrape engine needs to be flushed.
+bool recount_seeders(const std::string &name, const lt::sha1_hash &info_hash, const std::vector<std::string> &announce_urls);
+
+void process_scrape_results();
+
+void process_loaded_torrents();
+
+void process_finished_deletions();
+
+// Returns the userdata of a torrent that is seeding, or nullptr if the torrent is unknown
+torrent_userdata *find_userdata(const lt::torrent_handle &handle);
+
+void process_libtorrent_alerts();
+
+// Returns the earliest time (in seconds since epoch) at which the main loop has something to do other than processing alerts
+uint64_t next_deadline();
+
+// Discovers torrents, purges unused data and starts or stops seeding based on the collected statistics
+void run_update();
+
+// Declares every metric the main loop updates
+void describe_metrics();
+
+void update_gauges();
+
+extern std::vector<std::unique_ptr<lt::session>> sessions;
+extern uint64_t last_update_time;
+extern bool data_dir_scanned;
+extern loop_series loop_metrics;
+extern const uint64_t recount_timeout;
+extern const size_t max_trackers_per_recount;
+extern registry recounting_torrents;
+extern registry seeding_torrents;
+extern uint64_t last_resume_save_time;
+extern const uint64_t resume_save_interval;
+extern uint64_t last_session_state_save_time;
+extern const uint64_t session_state_save_interval;
+extern uint32_t resume_saves_outstanding;
+extern uint64_t last_upload_sample_time;
+extern const uint64_t upload_sample_interval;
+extern uint64_t last_memory_check_time;
+extern const uint64_t memory_check_interval;
+extern std::unordered_set<std::string> loading_torrents;
+extern std::unordered_set<std::string> loading_recounts;
+extern std::unordered_map<std::string, lt::add_torrent_params> prepared_torrents;
+extern std::unordered_map<std::string, uint64_t> identifying_files;
+extern std::unordered_set<std::string> torrents_without_files;
+extern std::unordered_map<std::string, uint64_t> selecting_torrents;
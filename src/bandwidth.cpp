@@ -0,0 +1,71 @@
+#include <bandwidth.hpp>
+#include <pch.hpp>
+
+#include <numeric>
+
+#include <stats.hpp>
+
+namespace bandwidth {
+	double weight_of(const stats::torrent &torrent, bool counted_as_seeder) {
+		uint32_t seeders = torrent.number_of_seeders == std::numeric_limits<uint32_t>::max() ? 0 : torrent.number_of_seeders;
+		double other_seeders = static_cast<double>(seeders - std::min<uint32_t>(seeders, counted_as_seeder ? 1 : 0));
+		return (torrent.number_of_leechers + 1.0) / ((other_seeders + 1.0) * (other_seeders + 1.0));
+	}
+
+	void allocate(uint64_t uplink, const std::vector<claim> &claims, std::vector<double> &rates) {
+		rates.assign(claims.size(), 0.0);
+
+		// Torrents that demand the least relative to their weight are satisfied first, and leave more for the others
+		std::vector<size_t> order(claims.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return claims[a].demand / claims[a].weight < claims[b].demand / claims[b].weight;
+		});
+
+		double total_weight = 0.0;
+		for (const claim &claim : claims)
+			total_weight += claim.weight;
+
+		double remaining = static_cast<double>(uplink);
+		double remaining_weight = total_weight;
+		for (size_t i : order) {
+			double share = remaining * claims[i].weight / remaining_weight;
+			rates[i] = std::min(claims[i].demand, share);
+			remaining -= rates[i];
+			remaining_weight -= claims[i].weight;
+		}
+
+		if (remaining > 0.0 && total_weight > 0.0) {
+			for (size_t i = 0; i < claims.size(); i++)
+				rates[i] += remaining * claims[i].weight / total_weight;
+		}
+	}
+
+	double smooth(double current, double target) {
+		return current + smoothing * (target - current);
+	}
+
+	void fit(uint64_t uplink, std::vector<double> &limits) {
+		double total = std::accumulate(limits.begin(), limits.end(), 0.0);
+		if (total <= static_cast<double>(uplink))
+			return;
+
+		double scale = static_cast<double>(uplink) / total;
+		for (double &limit : limits)
+			limit *= scale;
+	}
+
+	int unchoke_slots_of(double rate) {
+		return std::clamp(static_cast<int>(rate / rate_per_unchoke_slot), min_unchoke_slots, max_unchoke_slots);
+	}
+
+	const double demand_headroom = 2.0; // A torrent may double its upload between two samples
+	const double min_demand = 16 * 1024; // Assume every torrent could upload at least 16 KiB/s
+	const double min_rate = 1024; // Never starve a torrent completely, LibTorrent takes a limit of 0 to mean unlimited
+	const double smoothing = 0.5; // Close half of the gap to the target with every update
+	const double change_threshold = 0.05; // Leave limits that are within 5% of their target alone
+	const double rate_per_unchoke_slot = 32 * 1024; // Upload to a peer for every 32 KiB/s
+	const int min_unchoke_slots = 2;
+	const int max_unchoke_slots = 32;
+	const int connections_per_unchoke_slot = 5; // Stay connected to enough peers to find the ones that want to download
+}
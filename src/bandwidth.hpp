@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <vector>
+
+namespace stats {
+	struct torrent;
+}
+
+// Split of the uplink between the seeded torrents, so that it goes mostly to the swarms that depend on us
+namespace bandwidth {
+	struct claim {
+		double weight;
+		double demand; // Bytes per second the torrent could put to use, infinite if unknown
+	};
+
+	// Returns the leechers per other seeder, squared in the seeders, so that a swarm without other seeders outweighs one with a single other seeder several times
+	double weight_of(const stats::torrent &torrent, bool counted_as_seeder);
+
+	// Splits the uplink by weighted max-min fairness: no torrent gets more than it demands, and the rest is shared in proportion to the weights. Whatever nobody demands is handed out in proportion to the weights as well, so that demand can grow.
+	void allocate(uint64_t uplink, const std::vector<claim> &claims, std::vector<double> &rates);
+
+	// Moves a limit part of the way towards its target, so that limits settle instead of jumping with every recount
+	double smooth(double current, double target);
+
+	// Scales the limits down in proportion until they sum to at most the uplink, which smoothing and the minimum rate can push them over
+	void fit(uint64_t uplink, std::vector<double> &limits);
+
+	// Returns the number of peers a torrent with the upload rate may upload to at once
+	int unchoke_slots_of(double rate);
+
+	extern const double demand_headroom;
+	extern const double min_demand;
+	extern const double min_rate;
+	extern const double smoothing;
+	extern const double change_threshold;
+	extern const double rate_per_unchoke_slot;
+	extern const int min_unchoke_slots;
+	extern const int max_unchoke_slots;
+	extern const int connections_per_unchoke_slot;
+}
@@ -1,6 +1,8 @@
 #include <config.hpp>
 #include <pch.hpp>
 
+#include <logger.hpp>
+
 namespace config {
 	// Returns true or throws if should terminate
 	bool init(int argc, char **argv) {
@@ -14,13 +16,26 @@ namespace config {
 				std::cout << "	--version (-v)                               Show information about the program release." << std::endl;
 				std::cout << "	--update-delay (-u) {seconds}                Execute actions based on the collected seeder counts every {seconds} second(s). Seeders are recounted continuously and independently of the update delay. (default: 10)" << std::endl;
 				std::cout << "	--min-seeders-to-ignore (-i) {count}         Do not seed torrents with {count} or more seeders. (default: 3)" << std::endl;
-				std::cout << "	--min-age-to-recount-seeders (-c) {seconds}  Recount seeders for torrents every {seconds} second(s). (default: 24 * 60 * 60)" << std::endl;
+				std::cout << "	--min-age-to-recount-seeders (-c) {seconds}  Recount seeders for torrents every {seconds} second(s). Swarms that change a lot or are close to --min-seeders-to-ignore are recounted up to 4 times as often. (default: 24 * 60 * 60)" << std::endl;
+				std::cout << "	--max-age-to-recount-seeders (-C) {seconds}  Back off to recounting seeders of stable swarms far from --min-seeders-to-ignore every {seconds} second(s). (default: 7 * 24 * 60 * 60)" << std::endl;
 				std::cout << "	--max-parallel-recounts (-P) {count}         Only ever recount seeders for {count} torrents simultaneously. (default: 100)" << std::endl;
 				std::cout << "	--torrents-dir (-t) {path}                   Path to the directory containing the torrents. (default: ./torrents)" << std::endl;
-				std::cout << "	--data-dir (-D) {path}                       Path to the directory containing the torrent data. (default: ./data)" << std::endl;
-				std::cout << "	--tmp-dir (-T) {path}                        Path to the directory containing temporary torrent data. Used when recounting seeders. (default: /tmp/btup/{PID})" << std::endl;
+				std::cout << "	--data-dir (-D) {path}                       Path to the directory containing the torrent data, one subdirectory per info-hash. (default: ./data)" << std::endl;
+				std::cout << "	--tmp-dir (-T) {path}                        Deprecated and ignored. Recounts no longer download any data." << std::endl;
 				std::cout << "	--max-data-size (-s) {gibibytes}             Never allow data directory size to exceed {gibibytes} GiB space limit. (default: 100)" << std::endl;
-				std::cout << "	--verbose (-V)                               Actively report the status of the process. Useful for debugging." << std::endl;
+				std::cout << "	--metainfo-cache-size (-m) {mebibytes}       Keep up to {mebibytes} MiB of parsed .torrent files cached in memory. (default: 256)" << std::endl;
+				std::cout << "	--resume-dir (-r) {path}                     Path to the directory containing fast-resume data of seeded torrents and the DHT state of the sessions. (default: ./resume)" << std::endl;
+				std::cout << "	--max-deletion-rate (-d) {mebibytes}         Delete data of purged torrents in the background at no more than {mebibytes} MiB per second, or as fast as possible if 0. (default: 256)" << std::endl;
+				std::cout << "	--metrics-port (-M) {port}                   Serve metrics in the Prometheus text format on 127.0.0.1:{port}. Disabled if {port} is 0. (default: 0)" << std::endl;
+				std::cout << "	--sessions (-n) {count}                      Spread seeded torrents across {count} LibTorrent sessions by info-hash, each with a network thread and listen port of its own. (default: 1)" << std::endl;
+				std::cout << "	--listen-port (-p) {port}                    Listen for peers on port {port}, and on the ports that follow it if there are several sessions. A {port} of 0 lets the system pick. (default: 6881)" << std::endl;
+				std::cout << "	--session-profile (-o) {name}                Tune the LibTorrent sessions for a deployment: default (client defaults), seedbox (many active torrents and large send buffers) or low-memory. (default: default)" << std::endl;
+				std::cout << "	--memory-budget (-b) {mebibytes}             Keep the resident memory of the process within {mebibytes} MiB by limiting the connections and buffers of the sessions, and by cutting the connections and the metainfo cache while it is measured to be over. Disabled if {mebibytes} is 0. (default: 0)" << std::endl;
+				std::cout << "	--min-partial-size (-a) {gibibytes}          Seed only the rarest pieces of torrents that do not fit into --max-data-size, as long as at least {gibibytes} GiB of each fit. Disabled if {gibibytes} is 0. (default: 0)" << std::endl;
+				std::cout << "	--max-upload-rate (-U) {kibibytes}           Share an uplink of {kibibytes} KiB/s between the seeded torrents, most of it to the swarms with the fewest other seeders per leecher. Disabled if {kibibytes} is 0. (default: 0)" << std::endl;
+				std::cout << "	--log-level (-l) {level}                     Only report messages of {level} or above: debug, info, warning or error. (default: info)" << std::endl;
+				std::cout << "	--log-json (-j)                              Report messages as JSON objects, one per line." << std::endl;
+				std::cout << "	--verbose (-V)                               Same as --log-level debug. Actively report the status of the process. Useful for debugging." << std::endl;
 				return true;
 			} else if (arg == "--version" || arg == "-v") {
 				std::cout << "BitTorrent UP! 0.2.0" << std::endl;
@@ -58,15 +73,77 @@ namespace config {
 			} else if (arg == "--tmp-dir" || arg == "-T") {
 				if (i + 1 >= argc)
 					throw std::runtime_error("Missing argument for --tmp-dir.");
-				_tmp_dir = argv[i + 1];
+				logger::warning() << "--tmp-dir is deprecated and ignored, because recounts no longer download any data.";
 				i++;
 			} else if (arg == "--max-data-size" || arg == "-s") {
 				if (i + 1 >= argc)
 					throw std::runtime_error("Missing argument for --max-data-size.");
 				_max_data_size = std::stoull(argv[i + 1]);
 				i++;
+			} else if (arg == "--metainfo-cache-size" || arg == "-m") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --metainfo-cache-size.");
+				_metainfo_cache_size = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--resume-dir" || arg == "-r") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --resume-dir.");
+				_resume_dir = argv[i + 1];
+				i++;
+			} else if (arg == "--max-deletion-rate" || arg == "-d") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --max-deletion-rate.");
+				_max_deletion_rate = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--metrics-port" || arg == "-M") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --metrics-port.");
+				_metrics_port = static_cast<uint16_t>(std::stoul(argv[i + 1]));
+				i++;
+			} else if (arg == "--sessions" || arg == "-n") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --sessions.");
+				_sessions = std::max(1UL, std::stoul(argv[i + 1]));
+				i++;
+			} else if (arg == "--listen-port" || arg == "-p") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --listen-port.");
+				_listen_port = static_cast<uint16_t>(std::stoul(argv[i + 1]));
+				i++;
+			} else if (arg == "--max-age-to-recount-seeders" || arg == "-C") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --max-age-to-recount-seeders.");
+				_max_age_to_recount_seeds = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--session-profile" || arg == "-o") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --session-profile.");
+				_session_profile = argv[i + 1];
+				i++;
+			} else if (arg == "--memory-budget" || arg == "-b") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --memory-budget.");
+				_memory_budget = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--min-partial-size" || arg == "-a") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --min-partial-size.");
+				_min_partial_size = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--max-upload-rate" || arg == "-U") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --max-upload-rate.");
+				_max_upload_rate = std::stoull(argv[i + 1]);
+				i++;
+			} else if (arg == "--log-level" || arg == "-l") {
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing argument for --log-level.");
+				_log_level = argv[i + 1];
+				i++;
+			} else if (arg == "--log-json" || arg == "-j") {
+				_log_json = true;
 			} else if (arg == "--verbose" || arg == "-V") {
-				_verbose = true;
+				_log_level = "debug";
 			} else
 				throw std::runtime_error("Unknown option: " + arg);
 		}
@@ -97,16 +174,60 @@ namespace config {
 		return _data_dir;
 	}
 
-	const std::filesystem::path &tmp_dir() {
-		return _tmp_dir;
-	}
-
 	uint64_t max_data_size() {
 		return _max_data_size * 1024ULL * 1024ULL * 1024ULL;
 	}
 
-	bool verbose() {
-		return _verbose;
+	uint64_t metainfo_cache_size() {
+		return _metainfo_cache_size * 1024ULL * 1024ULL;
+	}
+
+	const std::filesystem::path &resume_dir() {
+		return _resume_dir;
+	}
+
+	uint64_t max_deletion_rate() {
+		return _max_deletion_rate * 1024ULL * 1024ULL;
+	}
+
+	uint16_t metrics_port() {
+		return _metrics_port;
+	}
+
+	const std::string &log_level() {
+		return _log_level;
+	}
+
+	bool log_json() {
+		return _log_json;
+	}
+
+	uint32_t sessions() {
+		return _sessions;
+	}
+
+	uint16_t listen_port() {
+		return _listen_port;
+	}
+
+	uint64_t max_age_to_recount_seeds() {
+		return _max_age_to_recount_seeds;
+	}
+
+	const std::string &session_profile() {
+		return _session_profile;
+	}
+
+	uint64_t memory_budget() {
+		return _memory_budget * 1024ULL * 1024ULL;
+	}
+
+	uint64_t min_partial_size() {
+		return _min_partial_size * 1024ULL * 1024ULL * 1024ULL;
+	}
+
+	uint64_t max_upload_rate() {
+		return _max_upload_rate * 1024ULL;
 	}
 
     uint64_t _update_delay = 10; // Discover new torrents and forget those that were deleted every 10 minutes
@@ -115,7 +236,18 @@ namespace config {
 	uint32_t _max_parallel_recounts = 100; // Only ever recount seeders for 100 torrents simultaneously
 	std::filesystem::path _torrents_dir = "./torrents";
 	std::filesystem::path _data_dir = "./data";
-	std::filesystem::path _tmp_dir = "/tmp/btup/" + std::to_string(getpid());
 	uint64_t _max_data_size = 100;
-	bool _verbose = false;
+	uint64_t _metainfo_cache_size = 256; // Keep up to 256 MiB of parsed metainfo in memory
+	std::filesystem::path _resume_dir = "./resume";
+	uint64_t _max_deletion_rate = 256; // Delete at most 256 MiB of data per second
+	uint16_t _metrics_port = 0;
+	std::string _log_level = "info";
+	bool _log_json = false;
+	uint32_t _sessions = 1;
+	uint16_t _listen_port = 6881;
+	uint64_t _max_age_to_recount_seeds = 7 * 24 * 60 * 60; // Back off to recounting stable swarms once a week
+	std::string _session_profile = "default";
+	uint64_t _memory_budget = 0; // MiB, 0 means unlimited
+	uint64_t _min_partial_size = 0; // GiB, 0 disables partial seeding
+	uint64_t _max_upload_rate = 0; // KiB/s, 0 leaves upload unlimited
 }
@@ -17,11 +17,33 @@ namespace config {
 
 	const std::filesystem::path &data_dir();
 
-	const std::filesystem::path &tmp_dir();
-
 	uint64_t max_data_size();
 
-	bool verbose();
+	uint64_t metainfo_cache_size();
+
+	const std::filesystem::path &resume_dir();
+
+	uint64_t max_deletion_rate();
+
+	uint16_t metrics_port();
+
+	const std::string &log_level();
+
+	bool log_json();
+
+	uint32_t sessions();
+
+	uint16_t listen_port();
+
+	uint64_t max_age_to_recount_seeds();
+
+	const std::string &session_profile();
+
+	uint64_t memory_budget();
+
+	uint64_t min_partial_size();
+
+	uint64_t max_upload_rate();
 
     extern uint64_t _update_delay; // Discover new torrents, unregister those that were deleted and purge unused data every 10 minutes
 	extern uint32_t _min_seeders_to_ignore; // Do not seed torrents with 3 or more seeds
@@ -29,7 +51,18 @@ namespace config {
 	extern uint32_t _max_parallel_recounts; // Only ever recount seeders for 100 torrents simultaneously
 	extern std::filesystem::path _torrents_dir;
 	extern std::filesystem::path _data_dir;
-	extern std::filesystem::path _tmp_dir;
 	extern uint64_t _max_data_size; // Never allow data directory size to exceed 100 GiB space limit.
-	extern bool _verbose;
+	extern uint64_t _metainfo_cache_size; // Keep up to 256 MiB of parsed metainfo in memory
+	extern std::filesystem::path _resume_dir;
+	extern uint64_t _max_deletion_rate; // Delete at most 256 MiB of data per second
+	extern uint16_t _metrics_port;
+	extern std::string _log_level;
+	extern bool _log_json;
+	extern uint32_t _sessions;
+	extern uint16_t _listen_port;
+	extern uint64_t _max_age_to_recount_seeds; // Back off to recounting stable swarms once a week
+	extern std::string _session_profile;
+	extern uint64_t _memory_budget; // MiB, 0 means unlimited
+	extern uint64_t _min_partial_size; // GiB, 0 disables partial seeding
+	extern uint64_t _max_upload_rate; // KiB/s, 0 leaves upload unlimited
 }
@@ -0,0 +1,180 @@
+#include <deletion.hpp>
+#include <pch.hpp>
+
+#include <sys/stat.h>
+
+#include <config.hpp>
+#include <loop.hpp>
+#include <logger.hpp>
+
+namespace deletion {
+	static const std::filesystem::path queue_path = "deletions.txt";
+
+	// Must be called with the lock held. Returns false if the thread should stop.
+	static bool sleep_until(std::unique_lock<std::mutex> &lock, std::chrono::steady_clock::time_point time) {
+		_condition.wait_until(lock, time, []() {
+			return !_running;
+		});
+		return _running;
+	}
+
+	// Unlinks every file in the directory at no more than the configured rate. Returns false if interrupted by stop.
+	static bool delete_directory(const std::filesystem::path &root) {
+		std::error_code error;
+
+		std::vector<std::filesystem::path> files;
+		for (auto it = std::filesystem::recursive_directory_iterator(root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+			if (it->symlink_status(error).type() != std::filesystem::file_type::directory)
+				files.push_back(it->path());
+		}
+
+		uint64_t rate = config::max_deletion_rate();
+		uint64_t bytes_deleted = 0;
+		auto start_time = std::chrono::steady_clock::now();
+
+		for (const auto &file : files) {
+			struct stat file_stat;
+			if (lstat(file.c_str(), &file_stat) == 0)
+				bytes_deleted += static_cast<uint64_t>(file_stat.st_blocks) * 512;
+			unlink(file.c_str());
+
+			// Sleep off whatever was deleted ahead of the budget
+			std::unique_lock<std::mutex> lock(_mutex);
+			auto budget_time = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(rate ? static_cast<double>(bytes_deleted) / rate : 0.0));
+			if (!sleep_until(lock, budget_time))
+				return false;
+		}
+
+		// Only empty directories are left
+		std::filesystem::remove_all(root, error);
+		return true;
+	}
+
+	static void run() {
+		while (true) {
+			std::string name;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, []() {
+					return !_running || !_queue.empty();
+				});
+				if (!_running)
+					return;
+
+				name = _queue.front();
+			}
+
+			if (!delete_directory(config::data_dir() / name))
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_queue.pop_front();
+				_finished.push_back(std::move(name));
+			}
+			loop::notify();
+		}
+	}
+
+	void start() {
+		std::ifstream file(queue_path);
+		std::string name;
+		while (std::getline(file, name)) {
+			if (!name.empty() && _pending.insert(name).second)
+				_queue.push_back(name);
+		}
+
+		if (!_queue.empty())
+			logger::info() << "Resuming deletion of data belonging to " << _queue.size() << " torrent" << (_queue.size() == 1 ? "." : "s.");
+
+		_running = true;
+		_thread = std::thread(run);
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_running = false;
+		}
+		_condition.notify_all();
+
+		if (_thread.joinable())
+			_thread.join();
+	}
+
+	void enqueue(const std::string &name) {
+		if (!_pending.insert(name).second)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_queue.push_back(name);
+		}
+		_condition.notify_all();
+		_dirty = true;
+	}
+
+	bool pending(const std::string &name) {
+		return _pending.contains(name);
+	}
+
+	const std::unordered_set<std::string> &pending() {
+		return _pending;
+	}
+
+	void pop_finished(std::vector<std::string> &names) {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			names.insert(names.end(), std::make_move_iterator(_finished.begin()), std::make_move_iterator(_finished.end()));
+			_finished.clear();
+		}
+
+		for (const std::string &name : names) {
+			if (_pending.erase(name))
+				_dirty = true;
+		}
+	}
+
+	void try_save() {
+		if (!_dirty)
+			return;
+
+		// Replace the queue atomically, so that a crash leaves either the old or the new one behind
+		std::filesystem::path tmp_path = queue_path.string() + ".tmp";
+		bool written;
+		{
+			std::ofstream file(tmp_path, std::ios::trunc);
+			for (const std::string &name : _pending)
+				file << name << '\n';
+			file.close();
+			written = !file.fail();
+		}
+
+		std::error_code error;
+		if (written)
+			std::filesystem::rename(tmp_path, queue_path, error);
+
+		// Keep the queue dirty, so that the next save tries again. Warn only once until it succeeds.
+		if (!written || error) {
+			if (!_save_failed)
+				logger::warning() << "Unable to write \"" << queue_path.string() << "\". Trying again on the next save.";
+			_save_failed = true;
+			return;
+		}
+
+		if (_save_failed)
+			logger::info() << "Wrote \"" << queue_path.string() << "\" again.";
+		_save_failed = false;
+		_dirty = false;
+	}
+
+	std::thread _thread;
+	bool _running = false;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<std::string> _queue;
+	std::vector<std::string> _finished;
+	std::unordered_set<std::string> _pending;
+	bool _dirty = false;
+	bool _save_failed = false;
+}
@@ -0,0 +1,40 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Deletes data directories of torrents on a background thread at a limited rate, so that large deletions neither block the main loop nor starve the disk
+namespace deletion {
+	// Resumes deletions that were queued before the last shutdown
+	void start();
+
+	// Stops at the next file. Unfinished deletions are resumed on the next start.
+	void stop();
+
+	void enqueue(const std::string &name);
+
+	// Returns true if the data of the torrent has been queued for deletion and is not completely gone yet
+	bool pending(const std::string &name);
+
+	const std::unordered_set<std::string> &pending();
+
+	// Moves names of torrents whose data is gone into names. The main loop is notified whenever a deletion finishes.
+	void pop_finished(std::vector<std::string> &names);
+
+	// Writes the queue to disk if it has changed. Logs a warning and keeps the queue dirty if it cannot be written.
+	void try_save();
+
+	extern std::thread _thread;
+	extern bool _running;
+	extern std::mutex _mutex;
+	extern std::condition_variable _condition;
+	extern std::deque<std::string> _queue;
+	extern std::vector<std::string> _finished;
+	extern std::unordered_set<std::string> _pending; // Only accessed by the main thread
+	extern bool _dirty;
+	extern bool _save_failed; // The last save failed and has been warned about
+}
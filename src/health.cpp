@@ -0,0 +1,89 @@
+#include <health.hpp>
+#include <pch.hpp>
+
+#include <cmath>
+
+namespace health {
+	static double percentile_of(const tracker &entry, double percentile) {
+		std::vector<float> latencies(entry.latencies.begin(), entry.latencies.begin() + entry.latency_count);
+		auto nth = latencies.begin() + static_cast<size_t>(percentile * static_cast<double>(latencies.size() - 1));
+		std::nth_element(latencies.begin(), nth, latencies.end());
+		return *nth;
+	}
+
+	void record_success(const std::string &url, double latency) {
+		tracker &entry = _trackers[url];
+		entry.latencies[entry.next_latency] = static_cast<float>(latency);
+		entry.next_latency = (entry.next_latency + 1) % entry.latencies.size();
+		entry.latency_count = std::min(entry.latency_count + 1, entry.latencies.size());
+		entry.success_rate += success_rate_weight * (1.0 - entry.success_rate);
+		entry.consecutive_failures = 0;
+		entry.retry_time = 0;
+	}
+
+	bool record_failure(const std::string &url, uint64_t now) {
+		tracker &entry = _trackers[url];
+		entry.success_rate -= success_rate_weight * entry.success_rate;
+		entry.consecutive_failures++;
+		if (entry.consecutive_failures < failures_to_back_off)
+			return false;
+
+		// Every failure after the tracker has come back doubles the time it is skipped for
+		uint32_t doublings = std::min<uint32_t>(entry.consecutive_failures - failures_to_back_off, 16);
+		entry.retry_time = now + std::min(max_back_off, min_back_off << doublings);
+		return entry.consecutive_failures == failures_to_back_off;
+	}
+
+	bool is_available(const std::string &url, uint64_t now) {
+		auto it = _trackers.find(url);
+		return it == _trackers.end() || it->second.retry_time <= now;
+	}
+
+	uint64_t timeout_of(const std::string &url, uint64_t max_timeout) {
+		auto it = _trackers.find(url);
+		if (it == _trackers.end() || it->second.latency_count < min_latency_samples)
+			return max_timeout;
+
+		uint64_t timeout = static_cast<uint64_t>(std::ceil(timeout_factor * percentile_of(it->second, timeout_percentile)));
+		return std::clamp(timeout, min_timeout, max_timeout);
+	}
+
+	void sort(std::vector<std::string> &urls) {
+		struct health_of {
+			double success_rate;
+			double median_latency;
+		};
+
+		// Trackers that have never answered are assumed to be as fast as any
+		std::vector<std::pair<health_of, std::string>> entries;
+		for (std::string &url : urls) {
+			auto it = _trackers.find(url);
+			health_of health{1.0, 0.0};
+			if (it != _trackers.end()) {
+				health.success_rate = it->second.success_rate;
+				health.median_latency = it->second.latency_count != 0 ? percentile_of(it->second, 0.5) : 0.0;
+			}
+			entries.emplace_back(health, std::move(url));
+		}
+
+		std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+			if (a.first.success_rate != b.first.success_rate)
+				return a.first.success_rate > b.first.success_rate;
+			return a.first.median_latency < b.first.median_latency;
+		});
+
+		urls.clear();
+		for (auto &[health, url] : entries)
+			urls.push_back(std::move(url));
+	}
+
+	std::unordered_map<std::string, tracker> _trackers;
+	const double success_rate_weight = 0.1; // The last 10 or so scrapes of a tracker decide its success rate
+	const uint32_t failures_to_back_off = 3;
+	const uint64_t min_back_off = 60; // Skip a tracker for a minute after 3 failures in a row
+	const uint64_t max_back_off = 60 * 60; // and for no more than an hour however often it fails after that
+	const size_t min_latency_samples = 8;
+	const double timeout_percentile = 0.95;
+	const double timeout_factor = 2.0; // Wait twice as long as 95% of the replies took
+	const uint64_t min_timeout = 3; // Leaves room for the whole-second resolution of recount timeouts
+}
@@ -0,0 +1,41 @@
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Latency and failures of every scraped tracker. Recounts ask the healthiest tracker of a torrent first, wait for it only as long as it usually takes to answer and skip trackers that keep failing.
+namespace health {
+	struct tracker {
+		std::array<float, 32> latencies; // Seconds, of the most recent replies
+		size_t next_latency = 0;
+		size_t latency_count = 0;
+		double success_rate = 1.0; // Decayed share of scrapes that were answered
+		uint32_t consecutive_failures = 0;
+		uint64_t retry_time = 0; // Once the tracker has failed too often in a row, it is skipped until then
+	};
+
+	void record_success(const std::string &url, double latency);
+
+	// Returns true if the tracker has just started backing off
+	bool record_failure(const std::string &url, uint64_t now);
+
+	// Returns false while the tracker is backing off
+	bool is_available(const std::string &url, uint64_t now);
+
+	// Returns the seconds to wait for a scrape reply. This is a multiple of the tracker's usual worst latency, or max_timeout until enough replies have been seen.
+	uint64_t timeout_of(const std::string &url, uint64_t max_timeout);
+
+	// Orders trackers by success rate, then by median latency. Trackers that are equally healthy keep their order.
+	void sort(std::vector<std::string> &urls);
+
+	extern std::unordered_map<std::string, tracker> _trackers;
+	extern const double success_rate_weight;
+	extern const uint32_t failures_to_back_off;
+	extern const uint64_t min_back_off;
+	extern const uint64_t max_back_off;
+	extern const size_t min_latency_samples;
+	extern const double timeout_percentile;
+	extern const double timeout_factor;
+	extern const uint64_t min_timeout;
+}
@@ -0,0 +1,141 @@
+#include <ledger.hpp>
+#include <pch.hpp>
+
+#include <sys/stat.h>
+
+#include <stats.hpp>
+
+namespace ledger {
+	uint64_t measure(const std::filesystem::path &path) {
+		uint64_t bytes = 0;
+		std::error_code error;
+		for (auto it = std::filesystem::recursive_directory_iterator(path, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+			// Count allocated blocks rather than file sizes, so that sparse files of partially downloaded torrents are not overcounted
+			struct stat file_stat;
+			if (lstat(it->path().c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+				bytes += static_cast<uint64_t>(file_stat.st_blocks) * 512;
+		}
+		return bytes;
+	}
+
+	static void unindex(const std::string &name) {
+		auto it = _ranks.find(name);
+		if (it == _ranks.end())
+			return;
+		_ranked.erase({it->second, name});
+		_ranks.erase(it);
+	}
+
+	// Only data that could be evicted is indexed
+	static void index(const std::string &name, uint64_t bytes) {
+		if (bytes == 0 || _deleting.contains(name))
+			return;
+
+		stats::torrent_id id = stats::find(name);
+		if (id == stats::no_id)
+			return;
+
+		scoring::rank rank = scoring::rank_of(stats::get(id));
+		_ranks.emplace(name, rank);
+		_ranked.emplace(rank, name);
+	}
+
+	void set(const std::string &name, uint64_t bytes) {
+		uint64_t &entry = _entries[name];
+		_total = _total - entry + bytes;
+		if (_deleting.contains(name))
+			_deleting_total = _deleting_total - entry + bytes;
+		entry = bytes;
+
+		if (bytes == 0)
+			unindex(name);
+		else if (!_ranks.contains(name))
+			index(name, bytes);
+	}
+
+	void remove(const std::string &name) {
+		unindex(name);
+
+		auto it = _entries.find(name);
+		if (it == _entries.end()) {
+			_deleting.erase(name);
+			return;
+		}
+		_total -= it->second;
+		if (_deleting.erase(name))
+			_deleting_total -= it->second;
+		_entries.erase(it);
+	}
+
+	uint64_t get(const std::string &name) {
+		auto it = _entries.find(name);
+		return it != _entries.end() ? it->second : 0;
+	}
+
+	uint64_t total() {
+		return _total;
+	}
+
+	void mark_deleting(const std::string &name) {
+		if (_deleting.insert(name).second)
+			_deleting_total += get(name);
+		unindex(name);
+	}
+
+	bool is_deleting(const std::string &name) {
+		return _deleting.contains(name);
+	}
+
+	uint64_t deleting_total() {
+		return _deleting_total;
+	}
+
+	const std::unordered_map<std::string, uint64_t> &get() {
+		return _entries;
+	}
+
+	void rerank() {
+		_ranked.clear();
+		_ranks.clear();
+		for (const auto &[name, bytes] : _entries)
+			index(name, bytes);
+	}
+
+	bool plan_eviction(uint64_t bytes_needed, const stats::torrent &kept, const std::string &excluded_name, std::vector<std::string> &names) {
+		// Data that is expected to serve the least per byte joins the pool first
+		scoring::rank kept_rank = scoring::rank_of(kept);
+		std::vector<std::pair<uint64_t, const std::string *>> pool;
+		uint64_t pool_bytes = 0;
+		for (auto it = _ranked.rbegin(); it != _ranked.rend() && pool_bytes < bytes_needed && kept_rank < it->first; it++) {
+			if (it->second == excluded_name)
+				continue;
+			uint64_t bytes = _entries.at(it->second);
+			pool.emplace_back(bytes, &it->second);
+			pool_bytes += bytes;
+		}
+
+		if (pool_bytes < bytes_needed)
+			return false;
+
+		// Taking the largest candidates first frees the space with the fewest torrents
+		std::sort(pool.begin(), pool.end(), [](const auto &a, const auto &b) {
+			return a.first > b.first;
+		});
+
+		uint64_t bytes_freed = 0;
+		for (const auto &[bytes, name] : pool) {
+			if (bytes_freed >= bytes_needed)
+				break;
+			bytes_freed += bytes;
+			names.push_back(*name);
+		}
+		return true;
+	}
+
+	std::unordered_map<std::string, uint64_t> _entries;
+	uint64_t _total = 0;
+	std::unordered_set<std::string> _deleting;
+	uint64_t _deleting_total = 0;
+	std::set<std::pair<scoring::rank, std::string>> _ranked; // Data that could be evicted, best ranked first
+	std::unordered_map<std::string, scoring::rank> _ranks; // Rank every name in _ranked is indexed by
+}
@@ -0,0 +1,47 @@
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <scoring.hpp>
+
+// Running account of the bytes the data directory of each torrent takes up on disk
+namespace ledger {
+	// Returns the number of bytes the directory occupies on disk
+	uint64_t measure(const std::filesystem::path &path);
+
+	void set(const std::string &name, uint64_t bytes);
+
+	void remove(const std::string &name);
+
+	// Returns 0 for torrents without data
+	uint64_t get(const std::string &name);
+
+	uint64_t total();
+
+	// Marks the data of a torrent as queued for deletion. It keeps counting towards the total until it is removed, but is never planned for eviction again.
+	void mark_deleting(const std::string &name);
+
+	bool is_deleting(const std::string &name);
+
+	// Returns the part of the total that is going to be freed by queued deletions
+	uint64_t deleting_total();
+
+	const std::unordered_map<std::string, uint64_t> &get();
+
+	// Ranks the data of every torrent again from its current statistics. Data added in between is ranked when it is added.
+	void rerank();
+
+	// Picks torrents that rank below the kept one whose data frees at least bytes_needed. The pool of candidates is widened from the lowest ranked data up until it holds enough bytes, and its largest data is taken first, so that as few torrents as possible are evicted. Returns false if no such set exists.
+	bool plan_eviction(uint64_t bytes_needed, const stats::torrent &kept, const std::string &excluded_name, std::vector<std::string> &names);
+
+	extern std::unordered_map<std::string, uint64_t> _entries;
+	extern uint64_t _total;
+	extern std::unordered_set<std::string> _deleting;
+	extern uint64_t _deleting_total;
+	extern std::set<std::pair<scoring::rank, std::string>> _ranked;
+	extern std::unordered_map<std::string, scoring::rank> _ranks;
+}
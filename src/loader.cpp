@@ -0,0 +1,115 @@
+#include <loader.hpp>
+#include <pch.hpp>
+
+#include <config.hpp>
+#include <metainfo.hpp>
+#include <resume.hpp>
+#include <loop.hpp>
+#include <util.hpp>
+
+namespace loader {
+	static void push_result(result &&value) {
+		node *item = new node{std::move(value), _results.load(std::memory_order_relaxed)};
+		while (!_results.compare_exchange_weak(item->next, item, std::memory_order_release, std::memory_order_relaxed));
+		loop::notify();
+	}
+
+	static void load(const job &job) {
+		result value{job.file, job.name, job.purpose, job.generation, "", {}, {}, {}};
+
+		try {
+			auto torrent_info = metainfo::get(config::torrents_dir() / job.file);
+			std::string name = util::to_hex(torrent_info->info_hashes().get_best());
+
+			// The file might have been replaced by a different torrent since it was identified
+			if (!job.name.empty() && name != job.name)
+				throw std::runtime_error("The file no longer describes the same torrent.");
+			value.name = name;
+
+			if (job.purpose == purpose::prepare) {
+				resume::load(job.name, torrent_info, value.params);
+				value.params.save_path = (config::data_dir() / job.name).string();
+				value.params.ti = std::make_shared<lt::torrent_info>(*torrent_info); // The session needs its own mutable copy
+			} else if (job.purpose == purpose::recount) {
+				value.info_hash = torrent_info->info_hashes().get_best();
+				for (const lt::announce_entry &entry : torrent_info->trackers())
+					value.trackers.push_back(entry.url);
+			}
+		} catch (std::exception &e) {
+			value.error = e.what();
+		}
+
+		push_result(std::move(value));
+	}
+
+	static void run() {
+		while (true) {
+			job next;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, []() {
+					return !_running || !_jobs.empty();
+				});
+				if (!_running)
+					return;
+
+				next = std::move(_jobs.front());
+				_jobs.pop_front();
+			}
+
+			load(next);
+		}
+	}
+
+	void start() {
+		_running = true;
+
+		unsigned int count = std::max(1U, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < count; i++)
+			_threads.emplace_back(run);
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_running = false;
+		}
+		_condition.notify_all();
+
+		for (std::thread &thread : _threads)
+			thread.join();
+		_threads.clear();
+
+		std::vector<result> discarded;
+		pop_results(discarded);
+	}
+
+	void request(const std::string &file, const std::string &name, loader::purpose purpose, uint64_t generation) {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.push_back(job{file, name, purpose, generation});
+		}
+		_condition.notify_one();
+	}
+
+	void pop_results(std::vector<result> &results) {
+		// Taking the whole stack at once leaves nothing for other consumers to race with
+		node *item = _results.exchange(nullptr, std::memory_order_acquire);
+
+		size_t first = results.size();
+		while (item) {
+			results.push_back(std::move(item->value));
+			node *next = item->next;
+			delete item;
+			item = next;
+		}
+		std::reverse(results.begin() + first, results.end());
+	}
+
+	std::vector<std::thread> _threads;
+	bool _running = false;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<job> _jobs;
+	std::atomic<node *> _results = nullptr;
+}
@@ -0,0 +1,58 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libtorrent/add_torrent_params.hpp>
+
+// Parses .torrent files on a pool of worker threads, so that the main loop keeps processing alerts while thousands of them are loaded
+namespace loader {
+	enum class purpose : uint8_t {
+		identify, // Find out which torrent the file describes
+		prepare, // Build add_torrent_params to seed the torrent
+		recount // Collect the trackers to scrape the torrent from
+	};
+
+	struct result {
+		std::string file;
+		std::string name; // Key of the torrent the file describes, empty if a file that was yet to be identified could not be parsed
+		loader::purpose purpose; // Copied from the job
+		uint64_t generation; // Copied from the job
+		std::string error; // Empty if the file was loaded successfully
+		lt::add_torrent_params params; // Ready to be added to the session, including resume data if there is any
+		lt::sha1_hash info_hash; // Set when loaded for a recount
+		std::vector<std::string> trackers; // Announce URLs of the torrent, set when loaded for a recount
+	};
+
+	struct job {
+		std::string file;
+		std::string name; // Key the file is expected to have, empty if it is yet to be identified
+		loader::purpose purpose;
+		uint64_t generation; // Tells the parse of a file apart from earlier parses of the same file
+	};
+
+	struct node {
+		result value;
+		node *next;
+	};
+
+	void start();
+
+	void stop();
+
+	// Queues the .torrent file to be parsed into the metainfo cache and identified. Depending on the purpose, the result also carries add_torrent_params or the trackers of the torrent called name.
+	void request(const std::string &file, const std::string &name, loader::purpose purpose, uint64_t generation = 0);
+
+	// Moves finished loads into results in the order they finished. The main loop is notified whenever new results arrive.
+	void pop_results(std::vector<result> &results);
+
+	extern std::vector<std::thread> _threads;
+	extern bool _running;
+	extern std::mutex _mutex;
+	extern std::condition_variable _condition;
+	extern std::deque<job> _jobs;
+	extern std::atomic<node *> _results; // Lock-free stack of finished loads, most recent first
+}
@@ -0,0 +1,261 @@
+#include <logger.hpp>
+#include <pch.hpp>
+
+#include <config.hpp>
+
+namespace logger {
+	static const uint64_t rate_limit_window = 60 * 1000; // Milliseconds
+	static const uint32_t rate_limit_messages = 10; // Per torrent and window
+
+	struct rate_limit {
+		uint64_t window_start;
+		uint32_t messages;
+		uint32_t suppressed;
+	};
+
+	static const char *level_names[] = {"debug", "info", "warning", "error"};
+
+	// Messages are rate limited where they are logged, so that suppressed ones are never formatted
+	static std::mutex limits_mutex;
+	static std::unordered_map<std::string, rate_limit> limits;
+
+	static uint64_t milliseconds_since_epoch() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	static bool pop(entry &value) {
+		slot &slot = _ring[_dequeue_position & (_capacity - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != _dequeue_position + 1)
+			return false;
+
+		value = std::move(slot.value);
+		slot.sequence.store(_dequeue_position + _capacity, std::memory_order_release); // Hand the slot back to producers
+		_dequeue_position++;
+		return true;
+	}
+
+	static void append_json_string(std::string &buffer, const std::string &value) {
+		static const char *hex = "0123456789abcdef";
+
+		buffer += '"';
+		for (char c : value) {
+			if (c == '"' || c == '\\') {
+				buffer += '\\';
+				buffer += c;
+			} else if (static_cast<unsigned char>(c) < 0x20) {
+				buffer += "\\u00";
+				buffer += hex[(c >> 4) & 0xF];
+				buffer += hex[c & 0xF];
+			} else
+				buffer += c;
+		}
+		buffer += '"';
+	}
+
+	static void format(std::string &buffer, const entry &value) {
+		if (!_json) {
+			buffer += value.message;
+			buffer += '\n';
+			return;
+		}
+
+		buffer += "{\"time\":" + std::to_string(value.time / 1000) + "." + std::to_string(1000 + value.time % 1000).substr(1);
+		buffer += ",\"level\":\"";
+		buffer += level_names[static_cast<int>(value.severity)];
+		buffer += '"';
+		if (!value.torrent.empty()) {
+			buffer += ",\"torrent\":";
+			append_json_string(buffer, value.torrent);
+		}
+		buffer += ",\"message\":";
+		append_json_string(buffer, value.message);
+		buffer += "}\n";
+	}
+
+
+	static void write_all(const std::string &buffer) {
+		size_t written = 0;
+		while (written < buffer.size()) {
+			ssize_t length = write(STDOUT_FILENO, buffer.data() + written, buffer.size() - written);
+			if (length < 0 && errno == EINTR)
+				continue;
+			if (length <= 0)
+				return; // Nobody is listening anymore
+			written += length;
+		}
+	}
+
+	static void submit_suppressed(const std::string &torrent, uint32_t suppressed) {
+		submit(level::info, std::string(torrent), "Suppressed " + std::to_string(suppressed) + " message" + (suppressed == 1 ? "" : "s") + " about \"" + torrent + "\".");
+	}
+
+	// Returns false if the message should be suppressed. Warnings and errors are never suppressed.
+	static bool check_rate_limit(level level, const std::string &torrent) {
+		if (torrent.empty() || level >= level::warning)
+			return true;
+
+		uint64_t now = milliseconds_since_epoch();
+		std::lock_guard<std::mutex> lock(limits_mutex);
+
+		// Forget torrents that have not been reported on for a while
+		if (limits.size() > 10000) {
+			std::erase_if(limits, [now](const auto &item) {
+				return now - item.second.window_start >= rate_limit_window && item.second.suppressed == 0;
+			});
+		}
+
+		auto [it, inserted] = limits.try_emplace(torrent, rate_limit{now, 0, 0});
+		rate_limit &limit = it->second;
+
+		if (now - limit.window_start >= rate_limit_window) {
+			if (limit.suppressed != 0)
+				submit_suppressed(torrent, limit.suppressed);
+			limit = rate_limit{now, 0, 0};
+		}
+
+		if (limit.messages >= rate_limit_messages) {
+			limit.suppressed++;
+			return false;
+		}
+
+		limit.messages++;
+		return true;
+	}
+
+	static void run() {
+		std::string buffer;
+		entry value;
+
+		while (true) {
+			uint32_t signal = _signal.load(std::memory_order_acquire);
+			bool running = _running;
+
+			// Write everything that is available at once
+			while (pop(value))
+				format(buffer, value);
+
+			if (uint64_t dropped = _dropped.exchange(0))
+				format(buffer, entry{milliseconds_since_epoch(), level::warning, "", "Dropped " + std::to_string(dropped) + " log message" + (dropped == 1 ? "" : "s") + ", because the writer could not keep up."});
+
+			if (!buffer.empty()) {
+				write_all(buffer);
+				buffer.clear();
+				continue;
+			}
+
+			if (!running)
+				return;
+
+			_signal.wait(signal, std::memory_order_acquire);
+		}
+	}
+
+	line::line(level level, std::string torrent) : _level(level), _torrent(std::move(torrent)) {
+		if (enabled(level) && check_rate_limit(level, _torrent))
+			_stream.emplace();
+	}
+
+	line::~line() {
+		if (_stream)
+			submit(_level, std::move(_torrent), _stream->str());
+	}
+
+	void start() {
+		const std::string &name = config::log_level();
+		auto it = std::find(std::begin(level_names), std::end(level_names), name);
+		if (it == std::end(level_names))
+			throw std::runtime_error("Unknown log level \"" + name + "\".");
+
+		_level = static_cast<level>(it - std::begin(level_names));
+		_json = config::log_json();
+
+		for (size_t i = 0; i < _capacity; i++)
+			_ring[i].sequence.store(i, std::memory_order_relaxed);
+
+		_running = true;
+		_thread = std::thread(run);
+	}
+
+	void stop() {
+		if (!_thread.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(limits_mutex);
+			for (auto &[torrent, limit] : limits) {
+				if (limit.suppressed != 0)
+					submit_suppressed(torrent, limit.suppressed);
+				limit.suppressed = 0;
+			}
+		}
+
+		_running = false;
+		_signal.fetch_add(1, std::memory_order_release);
+		_signal.notify_one();
+		_thread.join();
+	}
+
+	bool enabled(level level) {
+		return level >= _level;
+	}
+
+	void submit(level level, std::string &&torrent, std::string &&message) {
+		// Messages from before the writer started, or after it stopped, go out directly
+		if (!_running) {
+			std::string buffer;
+			format(buffer, entry{milliseconds_since_epoch(), level, std::move(torrent), std::move(message)});
+			write_all(buffer);
+			return;
+		}
+
+		uint64_t position = _enqueue_position.load(std::memory_order_relaxed);
+		slot *slot;
+		while (true) {
+			slot = &_ring[position & (_capacity - 1)];
+			int64_t difference = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire)) - static_cast<int64_t>(position);
+
+			if (difference == 0) {
+				// The slot is free, so claim it
+				if (_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			} else if (difference < 0) {
+				// Never block the caller, the writer reports what was lost instead
+				_dropped++;
+				return;
+			} else
+				position = _enqueue_position.load(std::memory_order_relaxed);
+		}
+
+		slot->value = entry{milliseconds_since_epoch(), level, std::move(torrent), std::move(message)};
+		slot->sequence.store(position + 1, std::memory_order_release);
+
+		_signal.fetch_add(1, std::memory_order_release);
+		_signal.notify_one();
+	}
+
+	line debug(std::string torrent) {
+		return line(level::debug, std::move(torrent));
+	}
+
+	line info(std::string torrent) {
+		return line(level::info, std::move(torrent));
+	}
+
+	line warning(std::string torrent) {
+		return line(level::warning, std::move(torrent));
+	}
+
+	line error(std::string torrent) {
+		return line(level::error, std::move(torrent));
+	}
+
+	std::array<slot, _capacity> _ring;
+	std::atomic<uint64_t> _enqueue_position = 0;
+	uint64_t _dequeue_position = 0;
+	std::atomic<uint32_t> _signal = 0;
+	std::atomic<uint64_t> _dropped = 0;
+	std::atomic<bool> _running = false;
+	std::thread _thread;
+	level _level = level::info;
+	bool _json = false;
+}
@@ -0,0 +1,79 @@
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Hands messages to a background writer through a lock-free ring buffer, so that reporting never blocks the main loop on stdout
+namespace logger {
+	enum class level : uint8_t {
+		debug,
+		info,
+		warning,
+		error
+	};
+
+	struct entry {
+		uint64_t time; // Milliseconds since epoch
+		level severity;
+		std::string torrent; // Messages about the same torrent are rate limited together, empty if the message is not about a torrent
+		std::string message;
+	};
+
+	struct slot {
+		std::atomic<uint64_t> sequence;
+		entry value;
+	};
+
+	// Collects a message and submits it when destroyed. Does nothing if its level is disabled or its torrent is over the rate limit, in which case no stream is created and nothing is formatted.
+	class line {
+	public:
+		line(level level, std::string torrent);
+
+		~line();
+
+		template<typename T>
+		line &operator<<(const T &value) {
+			if (_stream)
+				*_stream << value;
+			return *this;
+		}
+
+	private:
+		level _level;
+		std::string _torrent;
+		std::optional<std::ostringstream> _stream;
+	};
+
+	// Reads the level and format from config and starts the writer
+	void start();
+
+	// Writes every message that was submitted so far and stops the writer
+	void stop();
+
+	bool enabled(level level);
+
+	void submit(level level, std::string &&torrent, std::string &&message);
+
+	line debug(std::string torrent = "");
+
+	line info(std::string torrent = "");
+
+	line warning(std::string torrent = "");
+
+	line error(std::string torrent = "");
+
+	inline constexpr size_t _capacity = 16384; // Must be a power of two
+
+	extern std::array<slot, _capacity> _ring;
+	extern std::atomic<uint64_t> _enqueue_position;
+	extern uint64_t _dequeue_position; // Only accessed by the writer
+	extern std::atomic<uint32_t> _signal; // Bumped on every submission, so that the writer can sleep on it
+	extern std::atomic<uint64_t> _dropped; // Messages lost because the ring was full
+	extern std::atomic<bool> _running;
+	extern std::thread _thread;
+	extern level _level;
+	extern bool _json;
+}
@@ -0,0 +1,32 @@
+#include <loop.hpp>
+#include <pch.hpp>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+
+namespace loop {
+	void init() {
+		_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_event_fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to create the main loop event");
+	}
+
+	void notify() {
+		uint64_t value = 1;
+		[[maybe_unused]] ssize_t result = write(_event_fd, &value, sizeof(value));
+	}
+
+	void wait_until(uint64_t deadline) {
+		int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		int64_t timeout = std::max<int64_t>(0, static_cast<int64_t>(deadline) * 1000 - now);
+
+		pollfd fd{_event_fd, POLLIN, 0};
+		poll(&fd, 1, static_cast<int>(std::min<int64_t>(timeout, std::numeric_limits<int>::max())));
+
+		// Reset the counter, so that notifications which have already been handled do not wake the loop again
+		uint64_t value;
+		[[maybe_unused]] ssize_t result = read(_event_fd, &value, sizeof(value));
+	}
+
+	int _event_fd = -1;
+}
@@ -0,0 +1,13 @@
+#include <cstdint>
+
+namespace loop {
+	void init();
+
+	// Wakes up the main loop. Safe to call from any thread, including LibTorrent's alert notification callback, and from signal handlers.
+	void notify();
+
+	// Blocks until notified or until the deadline (in seconds since epoch) has passed
+	void wait_until(uint64_t deadline);
+
+	extern int _event_fd;
+}
@@ -0,0 +1,109 @@
+#include <metainfo.hpp>
+#include <pch.hpp>
+
+#include <sys/stat.h>
+
+#include <config.hpp>
+
+namespace metainfo {
+	static void erase(std::unordered_map<std::string, entry>::iterator it) {
+		_memory_usage -= it->second.memory_usage;
+		_lru.erase(it->second.lru_it);
+		_entries.erase(it);
+	}
+
+	static void evict_least_recently_used() {
+		// Never evict the most recently used entry, so that a single large torrent still gets cached
+		while (_memory_usage > std::min(config::metainfo_cache_size(), _limit) && _lru.size() > 1)
+			erase(_entries.find(_lru.back()));
+	}
+
+	static bool stat_file(const std::string &key, int64_t &mtime, uint64_t &file_size) {
+		struct stat file_stat;
+		if (stat(key.c_str(), &file_stat) != 0)
+			return false;
+
+		mtime = static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000LL + file_stat.st_mtim.tv_nsec;
+		file_size = static_cast<uint64_t>(file_stat.st_size);
+		return true;
+	}
+
+	// Must be called with the lock held
+	static std::shared_ptr<const lt::torrent_info> lookup(const std::string &key, int64_t mtime, uint64_t file_size) {
+		auto it = _entries.find(key);
+		if (it == _entries.end())
+			return nullptr;
+
+		if (it->second.mtime != mtime || it->second.file_size != file_size) {
+			erase(it); // The file has changed since it was parsed
+			return nullptr;
+		}
+
+		_lru.splice(_lru.begin(), _lru, it->second.lru_it);
+		return it->second.info;
+	}
+
+	std::shared_ptr<const lt::torrent_info> get(const std::filesystem::path &path) {
+		std::string key = path.string();
+
+		int64_t mtime;
+		uint64_t file_size;
+		if (!stat_file(key, mtime, file_size))
+			throw std::system_error(errno, std::generic_category(), "Unable to read \"" + key + "\"");
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (auto info = lookup(key, mtime, file_size))
+				return info;
+		}
+
+		auto info = std::make_shared<const lt::torrent_info>(
+			key,
+			lt::load_torrent_limits{
+				.max_buffer_size  = 100000000
+			}
+		);
+
+		// A parsed torrent keeps a copy of the info section, piece hashes and file list, which roughly doubles the size of the file
+		uint64_t memory_usage = 2 * file_size + sizeof(lt::torrent_info);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// Another thread might have parsed the same file in the meantime
+		auto it = _entries.find(key);
+		if (it != _entries.end())
+			erase(it);
+
+		_lru.push_front(key);
+		_entries[key] = entry{mtime, file_size, memory_usage, info, _lru.begin()};
+		_memory_usage += memory_usage;
+
+		evict_least_recently_used();
+
+		return info;
+	}
+
+	void forget(const std::filesystem::path &path) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _entries.find(path.string());
+		if (it != _entries.end())
+			erase(it);
+	}
+
+	uint64_t memory_usage() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _memory_usage;
+	}
+
+	void limit(uint64_t bytes) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_limit = bytes;
+		evict_least_recently_used();
+	}
+
+	std::unordered_map<std::string, entry> _entries;
+	std::list<std::string> _lru;
+	uint64_t _memory_usage = 0;
+	uint64_t _limit = std::numeric_limits<uint64_t>::max();
+	std::mutex _mutex;
+}
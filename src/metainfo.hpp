@@ -0,0 +1,37 @@
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <libtorrent/torrent_info.hpp>
+
+namespace metainfo {
+	struct entry {
+		int64_t mtime;
+		uint64_t file_size;
+		uint64_t memory_usage;
+		std::shared_ptr<const lt::torrent_info> info;
+		std::list<std::string>::iterator lru_it;
+	};
+
+	// Returns parsed metainfo of the .torrent file at path. The file is only parsed again if its mtime or size has changed. Throws if the file cannot be read or parsed.
+	// Safe to call from any thread. Files are parsed without holding the lock, so several threads can parse at once.
+	std::shared_ptr<const lt::torrent_info> get(const std::filesystem::path &path);
+
+	// Drops the cached metainfo of a .torrent file that was deleted
+	void forget(const std::filesystem::path &path);
+
+	uint64_t memory_usage();
+
+	// Caps the cache below --metainfo-cache-size while memory is short, and evicts down to the cap
+	void limit(uint64_t bytes);
+
+	extern std::unordered_map<std::string, entry> _entries;
+	extern std::list<std::string> _lru; // Most recently used paths come first
+	extern uint64_t _memory_usage;
+	extern uint64_t _limit;
+	extern std::mutex _mutex;
+}
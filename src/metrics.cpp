@@ -0,0 +1,172 @@
+#include <metrics.hpp>
+#include <pch.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace metrics {
+	// Upper bounds in seconds, fine enough for a single step of the main loop and wide enough for a scrape
+	static const std::array<double, _bucket_count - 1> bucket_bounds{0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60};
+
+	static series &find_series(const std::string &name, const std::string &labels) {
+		auto it = _families.find(name);
+		if (it == _families.end())
+			throw std::logic_error("Metric \"" + name + "\" has not been described.");
+
+		return it->second.entries.try_emplace(labels).first->second;
+	}
+
+	static std::string format_value(double value) {
+		std::ostringstream stream;
+		stream << value;
+		return stream.str();
+	}
+
+	static std::string join_labels(const std::string &labels, const std::string &extra) {
+		if (labels.empty())
+			return "{" + extra + "}";
+		return "{" + labels + "," + extra + "}";
+	}
+
+	static void serve(int fd) {
+		// The request is not even looked at, every path returns the metrics
+		char buffer[1024];
+		pollfd request{fd, POLLIN, 0};
+		if (poll(&request, 1, 1000) > 0)
+			[[maybe_unused]] ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+
+		std::string body = render();
+		std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+		size_t sent = 0;
+		while (sent < response.size()) {
+			ssize_t length = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+			if (length <= 0)
+				break;
+			sent += length;
+		}
+	}
+
+	static void run() {
+		while (_running) {
+			pollfd listener{_listen_fd, POLLIN, 0};
+			if (poll(&listener, 1, 250) <= 0)
+				continue;
+
+			int fd = accept4(_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd < 0)
+				continue;
+			serve(fd);
+			close(fd);
+		}
+	}
+
+	void describe(const std::string &name, metric_type type, const std::string &help) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		family &family = _families[name]; // Series that were already resolved stay valid
+		family.type = type;
+		family.help = help;
+	}
+
+	series &find(const std::string &name, const std::string &labels) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return find_series(name, labels);
+	}
+
+	void add(const std::string &name, const std::string &labels, double value) {
+		add(find(name, labels), value);
+	}
+
+	void set(const std::string &name, const std::string &labels, double value) {
+		set(find(name, labels), value);
+	}
+
+	void observe(const std::string &name, const std::string &labels, double value) {
+		observe(find(name, labels), value);
+	}
+
+	void add(series &series, double value) {
+		series.value.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	void set(series &series, double value) {
+		series.value.store(value, std::memory_order_relaxed);
+	}
+
+	void observe(series &series, double value) {
+		size_t bucket = std::lower_bound(bucket_bounds.begin(), bucket_bounds.end(), value) - bucket_bounds.begin();
+		series.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		series.sum.fetch_add(value, std::memory_order_relaxed);
+		series.count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::string render() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		std::string text;
+		for (const auto &[name, family] : _families) {
+			static const char *type_names[] = {"counter", "gauge", "histogram"};
+			text += "# HELP " + name + " " + family.help + "\n";
+			text += "# TYPE " + name + " " + type_names[static_cast<int>(family.type)] + "\n";
+
+			for (const auto &[labels, series] : family.entries) {
+				if (family.type != metric_type::histogram) {
+					text += name + (labels.empty() ? "" : "{" + labels + "}") + " " + format_value(series.value.load(std::memory_order_relaxed)) + "\n";
+					continue;
+				}
+
+				uint64_t cumulative = 0;
+				for (size_t i = 0; i < series.buckets.size(); i++) {
+					cumulative += series.buckets[i].load(std::memory_order_relaxed);
+					std::string bound = i < bucket_bounds.size() ? format_value(bucket_bounds[i]) : "+Inf";
+					text += name + "_bucket" + join_labels(labels, "le=\"" + bound + "\"") + " " + std::to_string(cumulative) + "\n";
+				}
+				text += name + "_sum" + (labels.empty() ? "" : "{" + labels + "}") + " " + format_value(series.sum.load(std::memory_order_relaxed)) + "\n";
+				text += name + "_count" + (labels.empty() ? "" : "{" + labels + "}") + " " + std::to_string(series.count.load(std::memory_order_relaxed)) + "\n";
+			}
+		}
+		return text;
+	}
+
+	void start(uint16_t port) {
+		if (port == 0)
+			return;
+
+		_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (_listen_fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to create the metrics socket");
+
+		int reuse = 1;
+		setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		// Metrics are only exposed locally
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		if (bind(_listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(_listen_fd, 16) != 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to listen for metrics on port " + std::to_string(port));
+
+		_running = true;
+		_thread = std::thread(run);
+	}
+
+	void stop() {
+		_running = false;
+		if (_thread.joinable())
+			_thread.join();
+
+		if (_listen_fd >= 0) {
+			close(_listen_fd);
+			_listen_fd = -1;
+		}
+	}
+
+	std::mutex _mutex;
+	std::map<std::string, family> _families;
+	std::thread _thread;
+	std::atomic<bool> _running = false;
+	int _listen_fd = -1;
+}
@@ -0,0 +1,73 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counters, gauges and histograms served in the Prometheus text format on a local HTTP port
+namespace metrics {
+	enum class metric_type {
+		counter,
+		gauge,
+		histogram
+	};
+
+	inline constexpr size_t _bucket_count = 14; // Bounds of metrics.cpp plus +Inf
+
+	// Updated without the registry lock, so that resolved series are cheap to update from the main loop
+	struct series {
+		std::atomic<double> value = 0; // Counters and gauges
+		std::array<std::atomic<uint64_t>, _bucket_count> buckets{}; // Histograms, not cumulative
+		std::atomic<double> sum = 0;
+		std::atomic<uint64_t> count = 0;
+	};
+
+	struct family {
+		metric_type type;
+		std::string help;
+		std::map<std::string, series> entries; // By label set, e.g. step="discover"
+	};
+
+	// Declares a metric. Every name has to be declared before it is updated.
+	void describe(const std::string &name, metric_type type, const std::string &help);
+
+	// Returns the series of a declared metric with the given labels. It stays at the same address, so hot paths can resolve it once and update it without looking it up again.
+	series &find(const std::string &name, const std::string &labels = "");
+
+	void add(const std::string &name, const std::string &labels = "", double value = 1);
+
+	void set(const std::string &name, const std::string &labels, double value);
+
+	void observe(const std::string &name, const std::string &labels, double value);
+
+	void add(series &series, double value = 1);
+
+	void set(series &series, double value);
+
+	void observe(series &series, double value);
+
+	// Runs function and records how long it took in a series of btup_step_duration_seconds
+	template<typename Function>
+	void time(series *step, Function &&function) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		observe(*step, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::string render();
+
+	// Serves the metrics on 127.0.0.1:port. Does nothing if port is 0.
+	void start(uint16_t port);
+
+	void stop();
+
+	extern std::mutex _mutex;
+	extern std::map<std::string, family> _families;
+	extern std::thread _thread;
+	extern std::atomic<bool> _running;
+	extern int _listen_fd;
+}
@@ -0,0 +1,42 @@
+#include <partial.hpp>
+#include <pch.hpp>
+
+#include <random>
+
+namespace partial {
+	uint64_t select_pieces(const lt::torrent_info &info, const lt::typed_bitfield<lt::piece_index_t> &have, const std::vector<int> &availability, uint64_t share, std::vector<lt::download_priority_t> &priorities) {
+		int num_pieces = info.num_pieces();
+		priorities.assign(static_cast<size_t>(num_pieces), lt::dont_download);
+
+		// Data on disk is kept either way, so it is part of the share
+		uint64_t bytes_selected = 0;
+		std::vector<int> candidates;
+		for (int i = 0; i < num_pieces; i++) {
+			lt::piece_index_t piece(i);
+			if (i < have.size() && have[piece]) {
+				priorities[static_cast<size_t>(i)] = lt::default_priority;
+				bytes_selected += static_cast<uint64_t>(info.piece_size(piece));
+			} else if (static_cast<size_t>(i) < availability.size() && availability[static_cast<size_t>(i)] > 0)
+				candidates.push_back(i);
+		}
+
+		// Shuffling first breaks ties differently every time, so that partial seeders of the same swarm end up with different pieces
+		static std::mt19937 generator(std::random_device{}());
+		std::shuffle(candidates.begin(), candidates.end(), generator);
+		std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+			return availability[static_cast<size_t>(a)] < availability[static_cast<size_t>(b)];
+		});
+
+		for (int i : candidates) {
+			uint64_t piece_size = static_cast<uint64_t>(info.piece_size(lt::piece_index_t(i)));
+			if (bytes_selected + piece_size > share)
+				continue; // The last piece is shorter and might still fit
+			priorities[static_cast<size_t>(i)] = lt::default_priority;
+			bytes_selected += piece_size;
+		}
+
+		return bytes_selected;
+	}
+
+	const uint64_t selection_delay = 60; // Give the peers of a torrent a minute to report which pieces they have
+}
@@ -0,0 +1,13 @@
+#include <cstdint>
+#include <vector>
+
+#include <libtorrent/torrent_info.hpp>
+#include <libtorrent/torrent_status.hpp>
+
+// Choice of the pieces to keep of a torrent that does not fit into the data directory as a whole
+namespace partial {
+	// Keeps the pieces that are already on disk and adds the pieces the fewest peers have until the share is used up. Pieces no peer has cannot be downloaded and are left out. Returns the number of bytes selected.
+	uint64_t select_pieces(const lt::torrent_info &info, const lt::typed_bitfield<lt::piece_index_t> &have, const std::vector<int> &availability, uint64_t share, std::vector<lt::download_priority_t> &priorities);
+
+	extern const uint64_t selection_delay;
+}
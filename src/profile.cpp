@@ -0,0 +1,145 @@
+#include <profile.hpp>
+#include <pch.hpp>
+
+#include <unistd.h>
+
+#include <config.hpp>
+#include <logger.hpp>
+#include <metainfo.hpp>
+
+namespace profile {
+	// Keeps thousands of torrents active, and gives fast peers deep send buffers and the upload slots
+	static void apply_seedbox(lt::settings_pack &settings) {
+		settings.set_int(lt::settings_pack::active_seeds, 10000);
+		settings.set_int(lt::settings_pack::active_limit, 10000);
+		settings.set_int(lt::settings_pack::active_downloads, 50);
+		settings.set_bool(lt::settings_pack::dont_count_slow_torrents, true);
+		settings.set_int(lt::settings_pack::connections_limit, 8000);
+		settings.set_int(lt::settings_pack::max_peerlist_size, 1000);
+		settings.set_int(lt::settings_pack::max_paused_peerlist_size, 200);
+		settings.set_int(lt::settings_pack::choking_algorithm, lt::settings_pack::rate_based_choker);
+		settings.set_int(lt::settings_pack::seed_choking_algorithm, lt::settings_pack::fastest_upload);
+		settings.set_int(lt::settings_pack::send_buffer_watermark, 4 * 1024 * 1024);
+		settings.set_int(lt::settings_pack::send_buffer_low_watermark, 512 * 1024);
+		settings.set_int(lt::settings_pack::send_buffer_watermark_factor, 150);
+		settings.set_int(lt::settings_pack::max_allowed_in_request_queue, 2000);
+		settings.set_int(lt::settings_pack::max_queued_disk_bytes, 16 * 1024 * 1024);
+		settings.set_int(lt::settings_pack::aio_threads, 16);
+		settings.set_int(lt::settings_pack::hashing_threads, 4);
+		settings.set_int(lt::settings_pack::file_pool_size, 2000);
+		settings.set_int(lt::settings_pack::suggest_mode, lt::settings_pack::suggest_read_cache);
+		settings.set_int(lt::settings_pack::alert_queue_size, 10000);
+	}
+
+	// Trades upload speed for a small and predictable footprint
+	static void apply_low_memory(lt::settings_pack &settings) {
+		settings.set_int(lt::settings_pack::active_seeds, 200);
+		settings.set_int(lt::settings_pack::active_limit, 250);
+		settings.set_int(lt::settings_pack::active_downloads, 4);
+		settings.set_int(lt::settings_pack::connections_limit, 200);
+		settings.set_int(lt::settings_pack::max_peerlist_size, 200);
+		settings.set_int(lt::settings_pack::max_paused_peerlist_size, 50);
+		settings.set_int(lt::settings_pack::choking_algorithm, lt::settings_pack::fixed_slots_choker);
+		settings.set_int(lt::settings_pack::unchoke_slots_limit, 8);
+		settings.set_int(lt::settings_pack::seed_choking_algorithm, lt::settings_pack::round_robin);
+		settings.set_int(lt::settings_pack::send_buffer_watermark, 128 * 1024);
+		settings.set_int(lt::settings_pack::send_buffer_low_watermark, 16 * 1024);
+		settings.set_int(lt::settings_pack::send_buffer_watermark_factor, 50);
+		settings.set_int(lt::settings_pack::max_queued_disk_bytes, 256 * 1024);
+		settings.set_int(lt::settings_pack::aio_threads, 2);
+		settings.set_int(lt::settings_pack::hashing_threads, 1);
+		settings.set_int(lt::settings_pack::checking_mem_usage, 64);
+		settings.set_int(lt::settings_pack::file_pool_size, 20);
+		settings.set_int(lt::settings_pack::suggest_mode, lt::settings_pack::no_piece_suggestions);
+	}
+
+	// Packs only hold what has been set on them, everything else is at its default
+	static uint64_t value_of(const lt::settings_pack &settings, int name) {
+		int value = settings.has_val(name) ? settings.get_int(name) : lt::default_settings().get_int(name);
+		return static_cast<uint64_t>(std::max(value, 0));
+	}
+
+	void apply(lt::settings_pack &settings) {
+		const std::string &name = config::session_profile();
+		if (name == "seedbox")
+			apply_seedbox(settings);
+		else if (name == "low-memory")
+			apply_low_memory(settings);
+		else if (name != "default")
+			throw std::runtime_error("Unknown session profile \"" + name + "\".");
+
+		if (config::memory_budget() == 0) {
+			logger::info() << "Using the " << name << " session profile.";
+			return;
+		}
+
+		// The metainfo cache is the only other part of the process that grows with the number of torrents
+		uint64_t fixed_memory = baseline_memory + config::metainfo_cache_size();
+		if (config::memory_budget() <= fixed_memory)
+			throw std::runtime_error("The memory budget must be larger than " + std::to_string(fixed_memory / 1024 / 1024) + " MiB.");
+		uint64_t session_budget = (config::memory_budget() - fixed_memory) / config::sessions();
+
+		// LibTorrent 2.0 leaves caching to the page cache, so what is left to bound are the queued disk buffers and the send buffers of every connection
+		uint64_t disk_memory = value_of(settings, lt::settings_pack::max_queued_disk_bytes) + value_of(settings, lt::settings_pack::checking_mem_usage) * 16 * 1024;
+		uint64_t send_buffer = value_of(settings, lt::settings_pack::send_buffer_watermark);
+
+		// Shallower send buffers are better than too few connections
+		while (disk_memory + min_connections * (send_buffer + connection_memory) > session_budget && send_buffer > 64 * 1024)
+			send_buffer /= 2;
+		settings.set_int(lt::settings_pack::send_buffer_watermark, static_cast<int>(send_buffer));
+
+		uint64_t per_connection = send_buffer + connection_memory;
+		if (disk_memory + min_connections * per_connection > session_budget)
+			throw std::runtime_error("The memory budget is too small for " + std::to_string(config::sessions()) + " session" + (config::sessions() == 1 ? "." : "s."));
+
+		int connections = static_cast<int>(std::min<uint64_t>((session_budget - disk_memory) / per_connection, std::numeric_limits<int>::max()));
+		connections = std::min(connections, static_cast<int>(value_of(settings, lt::settings_pack::connections_limit)));
+		settings.set_int(lt::settings_pack::connections_limit, connections);
+		_connections = connections;
+
+		logger::info() << "Using the " << name << " session profile with up to " << connections << " connections and "
+				<< (send_buffer / 1024) << " KiB send buffers per session.";
+	}
+
+	uint64_t resident_memory() {
+		std::ifstream file("/proc/self/statm");
+		uint64_t size, resident;
+		if (!(file >> size >> resident))
+			return 0;
+		return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	}
+
+	bool enforce(lt::settings_pack &settings) {
+		uint64_t resident = resident_memory();
+		if (config::memory_budget() == 0 || resident == 0)
+			return false;
+
+		double scale = _scale;
+		if (resident > config::memory_budget())
+			scale = std::max(scale * 0.75, min_scale);
+		else if (resident < config::memory_budget() / 10 * 8)
+			scale = std::min(scale / 0.75, 1.0);
+		if (scale == _scale)
+			return false;
+
+		if (scale < _scale)
+			logger::warning() << "Resident memory of " << (resident / 1024 / 1024) << " MiB is over the memory budget, allowing " << static_cast<int>(scale * 100) << "% of the connections and the metainfo cache.";
+		else
+			logger::info() << "Resident memory of " << (resident / 1024 / 1024) << " MiB is well within the memory budget, allowing " << static_cast<int>(scale * 100) << "% of the connections and the metainfo cache.";
+		_scale = scale;
+
+		metainfo::limit(static_cast<uint64_t>(static_cast<double>(config::metainfo_cache_size()) * scale));
+
+		// LibTorrent disconnects the peers over a lowered limit by itself
+		int connections = std::max(static_cast<int>(_connections * scale), std::min(min_connections, _connections));
+		settings.set_int(lt::settings_pack::connections_limit, connections);
+		return true;
+	}
+
+	const uint64_t baseline_memory = 64 * 1024 * 1024; // Code, session state and everything else that does not grow with the load
+	const uint64_t connection_memory = 64 * 1024; // Receive buffer and peer state of a connection
+	const int min_connections = 20;
+	const double min_scale = 1.0 / 64; // Some connections and cache are needed to seed at all
+	int _connections = 0;
+	double _scale = 1.0;
+}
@@ -0,0 +1,24 @@
+#include <cstdint>
+#include <string>
+
+#include <libtorrent/settings_pack.hpp>
+
+// Session settings for what the process is deployed on. LibTorrent's defaults suit a desktop client downloading a few torrents at a time.
+namespace profile {
+	// Applies the configured profile and fits the connections and buffers of every session into the configured memory budget. Throws if the profile is unknown or the budget is too small.
+	void apply(lt::settings_pack &settings);
+
+	// Returns the resident memory of the process from /proc/self/statm, or 0 if it cannot be read
+	uint64_t resident_memory();
+
+	// Checks the resident memory against the memory budget, because apply only estimates it. Over the budget, the connections of every session and the metainfo cache are cut by a quarter. Well under it, they grow back towards what apply chose.
+	// Returns true if settings now hold a connection limit the sessions need to apply.
+	bool enforce(lt::settings_pack &settings);
+
+	extern const uint64_t baseline_memory;
+	extern const uint64_t connection_memory;
+	extern const int min_connections;
+	extern const double min_scale;
+	extern int _connections; // Connection limit per session chosen by apply
+	extern double _scale; // Share of the connections and the metainfo cache that enforce currently allows
+}
@@ -0,0 +1,66 @@
+#include <registry.hpp>
+#include <pch.hpp>
+
+torrent_userdata &registry::insert(const std::string &name, bool seeding, const lt::sha1_hash &info_hash) {
+	torrent_userdata *userdata;
+	if (!_free.empty()) {
+		userdata = _free.back();
+		_free.pop_back();
+	} else
+		userdata = &_pool.emplace_back();
+
+	*userdata = torrent_userdata{name, seeding, 0, 0, lt::torrent_handle(), info_hash, "", false, {}, {}, 0, 0, 0, -1, 0, 0, _live.size()};
+	_live.push_back(userdata);
+	_by_name[name] = userdata;
+	_by_info_hash[info_hash] = userdata;
+	return *userdata;
+}
+
+void registry::bind(torrent_userdata &userdata, const lt::torrent_handle &handle) {
+	if (userdata.handle.is_valid())
+		_by_handle.erase(userdata.handle);
+	userdata.handle = handle;
+	_by_handle[handle] = &userdata;
+}
+
+void registry::erase(torrent_userdata &userdata) {
+	_by_name.erase(userdata.name);
+	_by_info_hash.erase(userdata.info_hash);
+	if (userdata.handle.is_valid())
+		_by_handle.erase(userdata.handle);
+
+	// Move the last live torrent into the gap
+	_live[userdata.live_index] = _live.back();
+	_live[userdata.live_index]->live_index = userdata.live_index;
+	_live.pop_back();
+
+	userdata = torrent_userdata{};
+	_free.push_back(&userdata);
+}
+
+torrent_userdata *registry::find(const std::string &name) const {
+	auto it = _by_name.find(name);
+	return it != _by_name.end() ? it->second : nullptr;
+}
+
+torrent_userdata *registry::find(const lt::sha1_hash &info_hash) const {
+	auto it = _by_info_hash.find(info_hash);
+	return it != _by_info_hash.end() ? it->second : nullptr;
+}
+
+torrent_userdata *registry::find(const lt::torrent_handle &handle) const {
+	auto it = _by_handle.find(handle);
+	return it != _by_handle.end() ? it->second : nullptr;
+}
+
+size_t registry::size() const {
+	return _live.size();
+}
+
+std::vector<torrent_userdata *>::const_iterator registry::begin() const {
+	return _live.begin();
+}
+
+std::vector<torrent_userdata *>::const_iterator registry::end() const {
+	return _live.end();
+}
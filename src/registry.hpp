@@ -0,0 +1,61 @@
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <libtorrent/torrent_handle.hpp>
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/socket.hpp>
+
+struct torrent_userdata {
+	std::string name;
+	bool seeding;
+	uint64_t add_time;
+	uint64_t timeout; // Seconds a recount waits for its current source from add_time on
+	lt::torrent_handle handle;
+	lt::sha1_hash info_hash;
+	std::string tracker; // Tracker scraped to recount seeders, empty once the recount has fallen back to the DHT
+	bool scrape_sent; // The scrape engine has sent the scrape to the tracker, rather than still holding it in its queue
+	std::vector<std::string> fallback_trackers; // Trackers to scrape next if the current one fails, healthiest last
+	std::set<lt::tcp::endpoint> dht_peers; // Distinct peers returned by the DHT lookup
+	int64_t total_upload; // Payload uploaded since the torrent was added, as last reported by the session
+	int64_t sampled_upload; // Part of total_upload that is already folded into the statistics
+	uint64_t sample_time;
+	double upload_rate; // Bytes per second between the last two samples, or -1 before the first sample
+	int upload_limit; // Bytes per second the allocator limits the torrent to, 0 until it has been allocated any
+	uint64_t partial_share; // Bytes the torrent may keep on disk if only its rarest pieces are seeded, 0 if all of them are
+	size_t live_index; // Position in the registry's list of live torrents
+};
+
+// Set of torrents indexed by name, info-hash and handle. Userdata stays at the same address until it is erased, so it can be handed to LibTorrent.
+class registry {
+public:
+	torrent_userdata &insert(const std::string &name, bool seeding, const lt::sha1_hash &info_hash);
+
+	// Indexes the torrent by the handle it has been assigned by the session
+	void bind(torrent_userdata &userdata, const lt::torrent_handle &handle);
+
+	void erase(torrent_userdata &userdata);
+
+	torrent_userdata *find(const std::string &name) const;
+
+	torrent_userdata *find(const lt::sha1_hash &info_hash) const;
+
+	torrent_userdata *find(const lt::torrent_handle &handle) const;
+
+	size_t size() const;
+
+	std::vector<torrent_userdata *>::const_iterator begin() const;
+
+	std::vector<torrent_userdata *>::const_iterator end() const;
+
+private:
+	std::deque<torrent_userdata> _pool;
+	std::vector<torrent_userdata *> _free;
+	std::vector<torrent_userdata *> _live;
+	std::unordered_map<std::string, torrent_userdata *> _by_name;
+	std::unordered_map<lt::sha1_hash, torrent_userdata *> _by_info_hash;
+	std::unordered_map<lt::torrent_handle, torrent_userdata *> _by_handle;
+};
@@ -0,0 +1,86 @@
+#include <resume.hpp>
+#include <pch.hpp>
+
+#include <libtorrent/read_resume_data.hpp>
+#include <libtorrent/write_resume_data.hpp>
+#include <libtorrent/session.hpp>
+
+#include <config.hpp>
+
+namespace resume {
+	static std::filesystem::path path_of(const std::string &name) {
+		return config::resume_dir() / (name + ".resume");
+	}
+
+	static std::filesystem::path path_of_session(uint32_t index) {
+		return config::resume_dir() / ("session-" + std::to_string(index) + ".state");
+	}
+
+	static bool read_file(const std::filesystem::path &path, std::vector<char> &buffer) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		buffer.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	static void write_file(const std::filesystem::path &path, const std::vector<char> &buffer) {
+		// Write to a temporary file first, so that a crash never leaves partial data behind
+		std::filesystem::create_directories(config::resume_dir());
+		std::filesystem::path tmp_path = path.string() + ".tmp";
+		{
+			std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+			file.write(buffer.data(), buffer.size());
+			if (!file)
+				throw std::runtime_error("Unable to write \"" + tmp_path.string() + "\".");
+		}
+		std::filesystem::rename(tmp_path, path);
+	}
+
+	bool load(const std::string &name, const std::shared_ptr<const lt::torrent_info> &torrent_info, lt::add_torrent_params &params) {
+		std::vector<char> buffer;
+		if (!read_file(path_of(name), buffer))
+			return false;
+
+		lt::error_code error;
+		lt::add_torrent_params loaded = lt::read_resume_data(buffer, error);
+		if (error || !(loaded.info_hashes == torrent_info->info_hashes())) // The torrent file might have been replaced by a different torrent of the same name
+			return false;
+
+		params = std::move(loaded);
+		return true;
+	}
+
+	void save(const std::string &name, const lt::add_torrent_params &params) {
+		write_file(path_of(name), lt::write_resume_data_buf(params));
+	}
+
+	void remove(const std::string &name) {
+		std::error_code error;
+		std::filesystem::remove(path_of(name), error);
+	}
+
+	void rename(const std::string &from, const std::string &to) {
+		std::error_code error;
+		std::filesystem::rename(path_of(from), path_of(to), error);
+	}
+
+	bool load_session(uint32_t index, lt::session_params &params) {
+		std::vector<char> buffer;
+		if (!read_file(path_of_session(index), buffer))
+			return false;
+
+		try {
+			params = lt::read_session_params(buffer, lt::session::save_dht_state);
+		} catch (std::exception &) {
+			return false;
+		}
+		return true;
+	}
+
+	void save_session(uint32_t index, const lt::session_params &params) {
+		// Settings come from the command line, so only the DHT state is kept
+		write_file(path_of_session(index), lt::write_session_params_buf(params, lt::session::save_dht_state));
+	}
+}
@@ -0,0 +1,25 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <libtorrent/add_torrent_params.hpp>
+#include <libtorrent/torrent_info.hpp>
+#include <libtorrent/session_params.hpp>
+
+// Fast-resume data of seeded torrents and the state of the sessions, so that restarts do not have to hash all of their data or bootstrap the DHT again
+namespace resume {
+	// Fills params from the resume data saved for the torrent. Returns false if there is none or it belongs to a different torrent.
+	bool load(const std::string &name, const std::shared_ptr<const lt::torrent_info> &torrent_info, lt::add_torrent_params &params);
+
+	void save(const std::string &name, const lt::add_torrent_params &params);
+
+	void remove(const std::string &name);
+
+	// Moves the resume data saved under an old name, if there is any
+	void rename(const std::string &from, const std::string &to);
+
+	// Fills params with the DHT state saved for the session with the given index. Returns false if there is none or it cannot be read.
+	bool load_session(uint32_t index, lt::session_params &params);
+
+	void save_session(uint32_t index, const lt::session_params &params);
+}
@@ -0,0 +1,107 @@
+#include <scheduler.hpp>
+#include <pch.hpp>
+
+#include <config.hpp>
+#include <util.hpp>
+
+namespace scheduler {
+	// Spreads recounts over a tenth of the recount interval, so that torrents discovered or restored together do not all come due at once
+	static uint64_t spread(uint32_t id, uint64_t interval) {
+		return (id * 2654435761ULL) % (interval / 10 + 1); // Knuth's multiplicative hash scatters consecutive ids
+	}
+
+	static uint64_t clamp_interval(uint64_t interval) {
+		uint64_t shortest = config::min_age_to_recount_seeds() / speed_up_factor;
+		uint64_t longest = std::max(config::min_age_to_recount_seeds(), config::max_age_to_recount_seeds());
+		return std::clamp(interval, shortest, longest);
+	}
+
+	uint64_t adapt_interval(uint64_t interval, uint32_t previous_seeders, uint32_t seeders) {
+		// A single count says nothing about how the swarm changes
+		if (interval == 0 || previous_seeders == std::numeric_limits<uint32_t>::max())
+			return config::min_age_to_recount_seeds();
+
+		uint32_t threshold = config::min_seeders_to_ignore();
+		uint32_t difference = seeders > previous_seeders ? seeders - previous_seeders : previous_seeders - seeders;
+		uint32_t larger = std::max(seeders, previous_seeders);
+
+		// Seeding decisions flip around the threshold, and a torrent being seeded counts itself too
+		bool near_threshold = (seeders > threshold ? seeders - threshold : threshold - seeders) <= threshold / 4 + 1;
+		bool far_from_threshold = seeders >= 2 * threshold || 2 * seeders < threshold;
+		bool changed_a_lot = difference > 1 && 2 * difference > larger;
+		bool stable = 5 * difference <= larger;
+
+		if (near_threshold || changed_a_lot)
+			return clamp_interval(interval / 2);
+		if (far_from_threshold && stable)
+			return clamp_interval(interval * 2);
+		return clamp_interval(interval);
+	}
+
+	void schedule(uint32_t id, uint64_t last_recounting_time, uint64_t interval) {
+		if (interval == 0)
+			interval = config::min_age_to_recount_seeds();
+
+		uint64_t due_time;
+		if (last_recounting_time == 0)
+			due_time = 0; // Never counted, so there is nothing to act on until it is
+		else {
+			due_time = last_recounting_time + interval + spread(id, interval);
+
+			// Statistics restored after a long downtime are all overdue, so spread them out instead of recounting them in one burst
+			uint64_t now = util::seconds_since_epoch();
+			if (due_time < now)
+				due_time = now + spread(id, config::min_age_to_recount_seeds());
+		}
+
+		if (id >= _due_times.size())
+			_due_times.resize(id + 1, unscheduled);
+		if (_due_times[id] == unscheduled)
+			_scheduled++;
+		_due_times[id] = due_time;
+		_queue.push(item{due_time, id});
+
+		// Drop outdated items once they make up most of the queue
+		if (_queue.size() > 2 * _scheduled + 1024) {
+			std::vector<item> items;
+			items.reserve(_scheduled);
+			for (uint32_t scheduled_id = 0; scheduled_id < _due_times.size(); scheduled_id++) {
+				if (_due_times[scheduled_id] != unscheduled)
+					items.push_back(item{_due_times[scheduled_id], scheduled_id});
+			}
+			_queue = std::priority_queue<item, std::vector<item>, std::greater<item>>(std::greater<item>(), std::move(items));
+		}
+	}
+
+	void unschedule(uint32_t id) {
+		if (id < _due_times.size() && _due_times[id] != unscheduled) {
+			_due_times[id] = unscheduled;
+			_scheduled--;
+		}
+	}
+
+	bool pop_due(uint64_t now, uint32_t &id) {
+		while (!_queue.empty() && _queue.top().due_time <= now) {
+			item top = _queue.top();
+			_queue.pop();
+
+			if (_due_times[top.id] != top.due_time)
+				continue; // Rescheduled or unscheduled since it was pushed
+
+			unschedule(top.id);
+			id = top.id;
+			return true;
+		}
+		return false;
+	}
+
+	uint64_t next_due_time() {
+		return _queue.empty() ? std::numeric_limits<uint64_t>::max() : _queue.top().due_time;
+	}
+
+	const uint64_t speed_up_factor = 4; // Recount swarms that need attention up to 4 times as often as the default interval
+	std::priority_queue<item, std::vector<item>, std::greater<item>> _queue;
+	const uint64_t unscheduled = std::numeric_limits<uint64_t>::max();
+	std::vector<uint64_t> _due_times;
+	size_t _scheduled = 0;
+}
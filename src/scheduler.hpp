@@ -0,0 +1,33 @@
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace scheduler {
+	struct item {
+		uint64_t due_time;
+		uint32_t id; // Torrent id in the statistics
+
+		auto operator<=>(const item &other) const = default;
+	};
+
+	// Returns the interval to wait after a recount. Swarms that changed a lot or are close to the seeding threshold are recounted sooner, stable swarms far from it back off exponentially.
+	uint64_t adapt_interval(uint64_t interval, uint32_t previous_seeders, uint32_t seeders);
+
+	// Schedules the next recount of a torrent, replacing the previous schedule. An interval of 0 stands for the default one.
+	void schedule(uint32_t id, uint64_t last_recounting_time, uint64_t interval);
+
+	void unschedule(uint32_t id);
+
+	// Pops a torrent whose recount is due. Returns false if there is none.
+	bool pop_due(uint64_t now, uint32_t &id);
+
+	// Returns the time (in seconds since epoch) at which the next recount is due
+	uint64_t next_due_time();
+
+	extern const uint64_t speed_up_factor;
+	extern const uint64_t unscheduled;
+	extern std::priority_queue<item, std::vector<item>, std::greater<item>> _queue; // Outdated items are skipped when popped
+	extern std::vector<uint64_t> _due_times; // Indexed by id, unscheduled for torrents without a pending recount
+	extern size_t _scheduled;
+}
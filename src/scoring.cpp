@@ -0,0 +1,40 @@
+#include <scoring.hpp>
+#include <pch.hpp>
+
+#include <cmath>
+
+#include <stats.hpp>
+
+namespace scoring {
+	void fold(stats::torrent &torrent, uint64_t bytes_uploaded, uint64_t seconds) {
+		if (seconds == 0)
+			return;
+
+		// The weight of the new sample depends on how long it covers, so irregular sampling does not skew the rate
+		double rate = static_cast<double>(bytes_uploaded) / static_cast<double>(seconds);
+		double alpha = 1.0 - std::exp(-static_cast<double>(seconds) / upload_time_constant);
+		torrent.upload_rate += alpha * (rate - torrent.upload_rate);
+		torrent.seeding_time += seconds;
+	}
+
+	double score(const stats::torrent &torrent) {
+		// Before anything has been measured, leechers that have few seeders to download from are the best guess of demand
+		double seeders = torrent.number_of_seeders == std::numeric_limits<uint32_t>::max() ? 0.0 : static_cast<double>(torrent.number_of_seeders);
+		double demand = demand_per_leecher * torrent.number_of_leechers / (seeders + 1.0);
+
+		double weight = std::min(1.0, static_cast<double>(torrent.seeding_time) / static_cast<double>(warm_up_time));
+		double rate = weight * torrent.upload_rate + (1.0 - weight) * demand;
+
+		uint64_t data_size = torrent.data_size != 0 ? torrent.data_size : unknown_data_size;
+		return rate / static_cast<double>(data_size);
+	}
+
+	rank rank_of(const stats::torrent &torrent) {
+		return rank{score(torrent), torrent.number_of_seeders};
+	}
+
+	const double upload_time_constant = 24 * 60 * 60; // Upload from a day ago weighs about a third of the upload right now
+	const uint64_t warm_up_time = 6 * 60 * 60; // Trust the measured upload rate fully after 6 hours of seeding
+	const double demand_per_leecher = 16 * 1024; // Assume every leecher downloads 16 KiB/s, split between the seeders
+	const uint64_t unknown_data_size = 1024 * 1024 * 1024; // Assume 1 GiB for torrents that have never been loaded
+}
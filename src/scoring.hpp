@@ -0,0 +1,33 @@
+#include <cstdint>
+
+namespace stats {
+	struct torrent;
+}
+
+// Ranks torrents by the bytes they are expected to serve per byte they take up on disk
+namespace scoring {
+	// Folds the payload uploaded over the last seconds into the decayed upload rate of a torrent
+	void fold(stats::torrent &torrent, uint64_t bytes_uploaded, uint64_t seconds);
+
+	// Returns the expected upload in bytes per second per byte stored. The measured upload rate takes over from the swarm's demand as the torrent is seeded for longer.
+	double score(const stats::torrent &torrent);
+
+	// Orders torrents by descending score, and torrents with equal scores by ascending seeder count. Torrents that come first are given disk space first.
+	struct rank {
+		double score;
+		uint32_t number_of_seeders;
+
+		bool operator<(const rank &other) const {
+			if (score != other.score)
+				return score > other.score;
+			return number_of_seeders < other.number_of_seeders;
+		}
+	};
+
+	rank rank_of(const stats::torrent &torrent);
+
+	extern const double upload_time_constant;
+	extern const uint64_t warm_up_time;
+	extern const double demand_per_leecher;
+	extern const uint64_t unknown_data_size;
+}
@@ -0,0 +1,674 @@
+#include <scrape.hpp>
+#include <pch.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <unordered_set>
+#include <random>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <loop.hpp>
+
+namespace scrape {
+	static constexpr size_t max_http_batch = 50; // Keeps the request line well below the URL length limits of common trackers
+	static constexpr size_t max_udp_batch = 74; // Largest scrape that fits into a single UDP packet as specified by BEP 15
+	static constexpr size_t max_operations = 64;
+	static constexpr size_t max_http_response_size = 4 * 1024 * 1024;
+	static constexpr auto operation_timeout = std::chrono::seconds(30); // Recounts give up on the tracker by then anyway
+	static constexpr auto http_connect_timeout = std::chrono::seconds(5); // Move on to the next address of the tracker after 5 seconds
+	static constexpr auto udp_retransmit_timeout = std::chrono::seconds(2); // BEP 15 doubles the wait after every retransmission. Its base of 15 seconds is scaled down to fit into a recount.
+	static constexpr uint32_t max_udp_attempts = 3; // Sent after 0, 2 and 6 seconds, given up on after 14 seconds
+	static constexpr auto resolve_cache_lifetime = std::chrono::minutes(10);
+	static constexpr auto failed_resolve_lifetime = std::chrono::minutes(1);
+	static constexpr auto connection_id_lifetime = std::chrono::minutes(1);
+	static constexpr uint64_t udp_protocol_id = 0x41727101980ULL;
+	static constexpr uint32_t udp_action_connect = 0;
+	static constexpr uint32_t udp_action_scrape = 2;
+
+	struct tracker_url {
+		bool udp;
+		std::string host;
+		std::string port;
+		std::string target; // Path and query of the HTTP scrape endpoint
+	};
+
+	struct address {
+		sockaddr_storage storage;
+		socklen_t length;
+	};
+
+	struct operation {
+		enum class state_t {
+			http_connecting,
+			http_sending,
+			http_receiving,
+			udp_connecting,
+			udp_scraping
+		};
+
+		state_t state;
+		std::string tracker;
+		tracker_url url;
+		std::vector<lt::sha1_hash> info_hashes;
+		std::vector<address> addresses; // Every address the host resolved to, tried in order
+		size_t address_index = 0;
+		int fd = -1;
+		std::chrono::steady_clock::time_point start;
+		std::chrono::steady_clock::time_point deadline;
+		std::chrono::steady_clock::time_point attempt_deadline; // Retransmit or move on to the next address if nothing has arrived by then
+		std::string buffer; // HTTP request while sending, response while receiving
+		size_t sent = 0;
+		std::string packet; // Last UDP request, sent again if it goes unanswered
+		uint32_t attempts = 0;
+		uint32_t transaction_id = 0;
+	};
+
+	template<typename T>
+	struct expiring {
+		T value;
+		std::chrono::steady_clock::time_point expiry;
+	};
+
+	// State below is only touched by the engine thread
+	static std::unordered_map<std::string, expiring<std::vector<address>>> resolve_cache; // No addresses if the host could not be resolved
+	static std::unordered_set<std::string> resolving;
+	static std::unordered_map<std::string, expiring<uint64_t>> connection_ids;
+	static std::mt19937 random_engine{std::random_device{}()};
+
+	// Host names are resolved on a thread of their own, because getaddrinfo blocks
+	static std::thread resolver_thread;
+	static std::mutex resolver_mutex;
+	static std::condition_variable resolver_condition;
+	static std::deque<std::pair<std::string, std::string>> resolver_queue; // Key and tracker
+	static std::vector<std::pair<std::string, std::vector<address>>> resolved;
+
+	static bool parse_tracker_url(const std::string &tracker, tracker_url &url) {
+		size_t scheme_end = tracker.find("://");
+		if (scheme_end == std::string::npos)
+			return false;
+
+		std::string scheme = tracker.substr(0, scheme_end);
+		std::transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c) {
+			return std::tolower(c);
+		});
+		if (scheme == "udp")
+			url.udp = true;
+		else if (scheme == "http")
+			url.udp = false;
+		else
+			return false; // TLS is not supported
+
+		size_t authority_begin = scheme_end + 3;
+		size_t authority_end = tracker.find_first_of("/?", authority_begin);
+		std::string authority = tracker.substr(authority_begin, authority_end - authority_begin);
+		url.target = authority_end == std::string::npos ? "/" : tracker.substr(authority_end);
+
+		size_t port_separator;
+		if (!authority.empty() && authority[0] == '[') {
+			size_t bracket = authority.find(']');
+			if (bracket == std::string::npos)
+				return false;
+			url.host = authority.substr(1, bracket - 1);
+			port_separator = authority.find(':', bracket);
+		} else {
+			port_separator = authority.rfind(':');
+			url.host = authority.substr(0, port_separator);
+		}
+		url.port = port_separator == std::string::npos ? std::string(url.udp ? "" : "80") : authority.substr(port_separator + 1);
+
+		if (url.host.empty() || url.port.empty())
+			return false;
+
+		if (!url.udp) {
+			// By convention the scrape endpoint is found by replacing "announce" in the last path segment with "scrape"
+			size_t path_end = std::min(url.target.find('?'), url.target.size());
+			size_t segment = url.target.rfind('/', path_end == 0 ? 0 : path_end - 1);
+			if (segment == std::string::npos || url.target.compare(segment + 1, 8, "announce") != 0)
+				return false;
+			url.target.replace(segment + 1, 8, "scrape");
+		}
+
+		return true;
+	}
+
+	bool is_scrapable(const std::string &tracker) {
+		tracker_url url;
+		return parse_tracker_url(tracker, url);
+	}
+
+	static std::string resolve_key_of(const tracker_url &url) {
+		return (url.udp ? "udp:" : "tcp:") + url.host + ":" + url.port;
+	}
+
+	static std::vector<address> resolve(const tracker_url &url) {
+		addrinfo hints{};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = url.udp ? SOCK_DGRAM : SOCK_STREAM;
+
+		std::vector<address> addresses;
+		addrinfo *info;
+		if (getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &info) != 0)
+			return addresses;
+
+		for (addrinfo *item = info; item; item = item->ai_next) {
+			address value{};
+			std::memcpy(&value.storage, item->ai_addr, item->ai_addrlen);
+			value.length = item->ai_addrlen;
+			addresses.push_back(value);
+		}
+		freeaddrinfo(info);
+		return addresses;
+	}
+
+	static void run_resolver() {
+		while (true) {
+			std::pair<std::string, std::string> next;
+			{
+				std::unique_lock<std::mutex> lock(resolver_mutex);
+				resolver_condition.wait(lock, []() {
+					return !_running || !resolver_queue.empty();
+				});
+				if (!_running)
+					return;
+
+				next = std::move(resolver_queue.front());
+				resolver_queue.pop_front();
+			}
+
+			tracker_url url;
+			std::vector<address> addresses;
+			if (parse_tracker_url(next.second, url))
+				addresses = resolve(url);
+
+			{
+				std::lock_guard<std::mutex> lock(resolver_mutex);
+				resolved.emplace_back(std::move(next.first), std::move(addresses));
+			}
+			uint64_t value = 1;
+			[[maybe_unused]] ssize_t result = write(_wake_fd, &value, sizeof(value));
+		}
+	}
+
+	static void write_u32(std::string &buffer, uint32_t value) {
+		for (int shift = 24; shift >= 0; shift -= 8)
+			buffer += static_cast<char>((value >> shift) & 0xFF);
+	}
+
+	static void write_u64(std::string &buffer, uint64_t value) {
+		write_u32(buffer, static_cast<uint32_t>(value >> 32));
+		write_u32(buffer, static_cast<uint32_t>(value));
+	}
+
+	static uint32_t read_u32(const char *data) {
+		const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+		return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+	}
+
+	static uint64_t read_u64(const char *data) {
+		return (uint64_t(read_u32(data)) << 32) | read_u32(data + 4);
+	}
+
+	static bool send_packet(operation &op, const std::string &packet) {
+		return send(op.fd, packet.data(), packet.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(packet.size());
+	}
+
+	static bool send_udp_packet(operation &op, std::string &&packet) {
+		op.packet = std::move(packet);
+		op.attempts = 1;
+		op.attempt_deadline = std::chrono::steady_clock::now() + udp_retransmit_timeout;
+		return send_packet(op, op.packet);
+	}
+
+	static bool send_udp_connect(operation &op) {
+		op.transaction_id = random_engine();
+		op.state = operation::state_t::udp_connecting;
+
+		std::string packet;
+		write_u64(packet, udp_protocol_id);
+		write_u32(packet, udp_action_connect);
+		write_u32(packet, op.transaction_id);
+		return send_udp_packet(op, std::move(packet));
+	}
+
+	static bool send_udp_scrape(operation &op, uint64_t connection_id) {
+		op.transaction_id = random_engine();
+		op.state = operation::state_t::udp_scraping;
+
+		std::string packet;
+		write_u64(packet, connection_id);
+		write_u32(packet, udp_action_scrape);
+		write_u32(packet, op.transaction_id);
+		for (const lt::sha1_hash &info_hash : op.info_hashes)
+			packet.append(info_hash.data(), info_hash.size());
+		return send_udp_packet(op, std::move(packet));
+	}
+
+	static std::string build_http_request(const operation &op) {
+		static const char *hex = "0123456789ABCDEF";
+
+		std::string request = "GET " + op.url.target;
+		char separator = op.url.target.find('?') == std::string::npos ? '?' : '&';
+		for (const lt::sha1_hash &info_hash : op.info_hashes) {
+			request += separator;
+			request += "info_hash=";
+			for (size_t i = 0; i < info_hash.size(); i++) {
+				unsigned char c = static_cast<unsigned char>(info_hash.data()[i]);
+				if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+					request += static_cast<char>(c);
+				else {
+					request += '%';
+					request += hex[c >> 4];
+					request += hex[c & 0xF];
+				}
+			}
+			separator = '&';
+		}
+
+		// HTTP/1.0 keeps the response free of chunked encoding and the connection is closed once it has been sent
+		request += " HTTP/1.0\r\nHost: " + op.url.host + "\r\nUser-Agent: btup/0.2.0\r\nAccept-Encoding: identity\r\nConnection: close\r\n\r\n";
+		return request;
+	}
+
+	// Opens a socket to the current address of the tracker and starts the request. Returns false if that fails.
+	static bool connect_to_address(operation &op) {
+		const address &target = op.addresses[op.address_index];
+		op.fd = socket(target.storage.ss_family, (op.url.udp ? SOCK_DGRAM : SOCK_STREAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (op.fd < 0)
+			return false;
+
+		if (connect(op.fd, reinterpret_cast<const sockaddr *>(&target.storage), target.length) != 0 && errno != EINPROGRESS)
+			return false;
+
+		if (op.url.udp) {
+			auto it = connection_ids.find(op.tracker);
+			if (it != connection_ids.end() && it->second.expiry > std::chrono::steady_clock::now())
+				return send_udp_scrape(op, it->second.value);
+			return send_udp_connect(op);
+		}
+
+		op.state = operation::state_t::http_connecting;
+		op.buffer = build_http_request(op);
+		op.sent = 0;
+		op.attempt_deadline = std::chrono::steady_clock::now() + http_connect_timeout;
+		return true;
+	}
+
+	// Moves on to the next address of the tracker. Returns false once no address is left.
+	static bool next_address(operation &op) {
+		while (op.address_index + 1 < op.addresses.size()) {
+			if (op.fd >= 0)
+				close(op.fd);
+			op.fd = -1;
+			op.address_index++;
+			if (connect_to_address(op))
+				return true;
+		}
+		return false;
+	}
+
+	static bool begin(operation &op, const std::vector<address> &addresses) {
+		if (addresses.empty())
+			return false;
+
+		op.addresses = addresses;
+		op.start = std::chrono::steady_clock::now();
+		op.deadline = op.start + operation_timeout;
+		return connect_to_address(op) || next_address(op);
+	}
+
+	// Called when the current attempt has gone unanswered. Returns false once the operation has run out of attempts and addresses.
+	static bool retry(operation &op) {
+		if (op.url.udp && op.attempts < max_udp_attempts) {
+			op.attempt_deadline = std::chrono::steady_clock::now() + udp_retransmit_timeout * (1 << op.attempts);
+			op.attempts++;
+			return send_packet(op, op.packet) || next_address(op);
+		}
+		return next_address(op);
+	}
+
+	static double latency_of(const operation &op) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - op.start).count();
+	}
+
+	static void fail(const operation &op, std::vector<result> &results) {
+		for (const lt::sha1_hash &info_hash : op.info_hashes)
+			results.push_back(result{info_hash, op.tracker, false, -1, -1, -1, -1});
+	}
+
+	// Fails the operation over to the next address of the tracker after an error. Returns true if no address is left and the operation has failed.
+	static bool fail_over(operation &op, std::vector<result> &results) {
+		if (next_address(op))
+			return false;
+		fail(op, results);
+		return true;
+	}
+
+	static void parse_http_response(const operation &op, std::vector<result> &results) {
+		size_t header_end = op.buffer.find("\r\n\r\n");
+		if (header_end == std::string::npos || header_end < 12 || op.buffer.compare(0, 7, "HTTP/1.") != 0 || op.buffer.compare(8, 4, " 200") != 0) {
+			fail(op, results);
+			return;
+		}
+
+		std::string_view body(op.buffer.data() + header_end + 4, op.buffer.size() - header_end - 4);
+		lt::error_code error;
+		lt::bdecode_node root = lt::bdecode(lt::span<char const>(body.data(), body.size()), error);
+		if (error || root.type() != lt::bdecode_node::dict_t) {
+			fail(op, results);
+			return;
+		}
+
+		double latency = latency_of(op);
+		lt::bdecode_node files = root.dict_find_dict("files");
+		for (const lt::sha1_hash &info_hash : op.info_hashes) {
+			lt::bdecode_node file = files ? files.dict_find_dict(std::string_view(info_hash.data(), info_hash.size())) : lt::bdecode_node();
+			if (!file) {
+				results.push_back(result{info_hash, op.tracker, false, -1, -1, -1, latency});
+				continue;
+			}
+
+			results.push_back(result{
+				info_hash,
+				op.tracker,
+				true,
+				static_cast<int32_t>(file.dict_find_int_value("complete", -1)),
+				static_cast<int32_t>(file.dict_find_int_value("incomplete", -1)),
+				static_cast<int32_t>(file.dict_find_int_value("downloaded", -1)),
+				latency
+			});
+		}
+	}
+
+	// Advances the operation after its socket became ready. Returns true once the operation has finished, successfully or not.
+	static bool advance(operation &op, std::vector<result> &results) {
+		switch (op.state) {
+		case operation::state_t::http_connecting: {
+			int error = 0;
+			socklen_t length = sizeof(error);
+			if (getsockopt(op.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+				return fail_over(op, results);
+			op.state = operation::state_t::http_sending;
+			op.attempt_deadline = op.deadline; // Only connecting is retried, a request that has been sent might have been processed
+			[[fallthrough]];
+		}
+		case operation::state_t::http_sending: {
+			ssize_t sent = send(op.fd, op.buffer.data() + op.sent, op.buffer.size() - op.sent, MSG_NOSIGNAL);
+			if (sent < 0) {
+				if (errno == EAGAIN || errno == EINTR)
+					return false;
+				fail(op, results);
+				return true;
+			}
+			op.sent += sent;
+			if (op.sent == op.buffer.size()) {
+				op.buffer.clear();
+				op.state = operation::state_t::http_receiving;
+			}
+			return false;
+		}
+		case operation::state_t::http_receiving: {
+			char chunk[16 * 1024];
+			ssize_t received = recv(op.fd, chunk, sizeof(chunk), 0);
+			if (received < 0) {
+				if (errno == EAGAIN || errno == EINTR)
+					return false;
+				fail(op, results);
+				return true;
+			}
+			if (received == 0) {
+				parse_http_response(op, results);
+				return true;
+			}
+			op.buffer.append(chunk, received);
+			if (op.buffer.size() > max_http_response_size) {
+				fail(op, results);
+				return true;
+			}
+			return false;
+		}
+		case operation::state_t::udp_connecting:
+		case operation::state_t::udp_scraping: {
+			char packet[8 + 12 * max_udp_batch];
+			ssize_t received = recv(op.fd, packet, sizeof(packet), 0);
+			if (received < 0) {
+				if (errno == EAGAIN || errno == EINTR)
+					return false;
+				return fail_over(op, results); // Most likely refused by an address the tracker no longer listens on
+			}
+			if (received < 8 || read_u32(packet + 4) != op.transaction_id)
+				return false; // Not a response to this request
+
+			uint32_t action = read_u32(packet);
+			if (op.state == operation::state_t::udp_connecting) {
+				if (action != udp_action_connect || received < 16 || !send_udp_scrape(op, read_u64(packet + 8))) {
+					fail(op, results);
+					return true;
+				}
+				connection_ids[op.tracker] = {read_u64(packet + 8), std::chrono::steady_clock::now() + connection_id_lifetime};
+				return false;
+			}
+
+			if (action != udp_action_scrape) {
+				connection_ids.erase(op.tracker); // Most likely an error caused by an expired connection ID
+				fail(op, results);
+				return true;
+			}
+
+			// Each torrent is answered with seeders, completed downloads and leechers, in the order of the request
+			double latency = latency_of(op);
+			for (size_t i = 0; i < op.info_hashes.size(); i++) {
+				const char *entry = packet + 8 + 12 * i;
+				if (entry + 12 > packet + received) {
+					results.push_back(result{op.info_hashes[i], op.tracker, false, -1, -1, -1, latency});
+					continue;
+				}
+				results.push_back(result{
+					op.info_hashes[i],
+					op.tracker,
+					true,
+					static_cast<int32_t>(read_u32(entry)),
+					static_cast<int32_t>(read_u32(entry + 8)),
+					static_cast<int32_t>(read_u32(entry + 4)),
+					latency
+				});
+			}
+			return true;
+		}
+		}
+		return true;
+	}
+
+	static short wanted_events(const operation &op) {
+		if (op.state == operation::state_t::http_connecting || op.state == operation::state_t::http_sending)
+			return POLLOUT;
+		return POLLIN;
+	}
+
+	static void run() {
+		std::unordered_map<std::string, std::deque<lt::sha1_hash>> queued;
+		std::list<operation> operations;
+		std::unordered_set<std::string> busy_trackers; // At most one request is in flight per tracker, so that the rest can be batched behind it
+
+		while (_running) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (auto &[tracker, info_hashes] : _requests)
+					queued[tracker].insert(queued[tracker].end(), info_hashes.begin(), info_hashes.end());
+				_requests.clear();
+			}
+			{
+				std::lock_guard<std::mutex> lock(resolver_mutex);
+				auto now = std::chrono::steady_clock::now();
+				for (auto &[key, addresses] : resolved) {
+					auto lifetime = addresses.empty() ? failed_resolve_lifetime : resolve_cache_lifetime; // Retry failed lookups sooner
+					resolve_cache[key] = {std::move(addresses), now + lifetime};
+					resolving.erase(key);
+				}
+				resolved.clear();
+			}
+
+			std::vector<result> results;
+			std::vector<sent_request> sent;
+
+			// Start a batch for every idle tracker that has torrents queued
+			for (auto it = queued.begin(); it != queued.end() && operations.size() < max_operations;) {
+				auto &[tracker, info_hashes] = *it;
+				if (busy_trackers.contains(tracker)) {
+					it++;
+					continue;
+				}
+
+				operation op;
+				op.tracker = tracker;
+				bool valid = parse_tracker_url(tracker, op.url);
+
+				// Batches wait in the queue while the host of their tracker is being resolved
+				const std::vector<address> *addresses = nullptr;
+				if (valid) {
+					std::string key = resolve_key_of(op.url);
+					auto cached = resolve_cache.find(key);
+					if (cached == resolve_cache.end() || cached->second.expiry <= std::chrono::steady_clock::now()) {
+						if (resolving.insert(key).second) {
+							std::lock_guard<std::mutex> lock(resolver_mutex);
+							resolver_queue.emplace_back(key, tracker);
+							resolver_condition.notify_one();
+						}
+						it++;
+						continue;
+					}
+					addresses = &cached->second.value;
+				}
+
+				size_t batch_size = std::min(info_hashes.size(), op.url.udp ? max_udp_batch : max_http_batch);
+				op.info_hashes.assign(info_hashes.begin(), info_hashes.begin() + batch_size);
+				info_hashes.erase(info_hashes.begin(), info_hashes.begin() + batch_size);
+
+				if (valid && begin(op, *addresses)) {
+					for (const lt::sha1_hash &info_hash : op.info_hashes)
+						sent.push_back(sent_request{info_hash, tracker});
+					busy_trackers.insert(tracker);
+					operations.push_back(std::move(op));
+				} else {
+					if (op.fd >= 0)
+						close(op.fd);
+					fail(op, results);
+				}
+
+				if (info_hashes.empty())
+					it = queued.erase(it);
+				else
+					it++;
+			}
+
+			std::vector<pollfd> fds;
+			fds.push_back(pollfd{_wake_fd, POLLIN, 0});
+			auto now = std::chrono::steady_clock::now();
+			auto deadline = now + std::chrono::hours(1);
+			for (const operation &op : operations) {
+				fds.push_back(pollfd{op.fd, wanted_events(op), 0});
+				deadline = std::min({deadline, op.deadline, op.attempt_deadline});
+			}
+
+			int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count());
+			poll(fds.data(), fds.size(), std::max(timeout, 0));
+
+			uint64_t value;
+			[[maybe_unused]] ssize_t drained = read(_wake_fd, &value, sizeof(value));
+
+			now = std::chrono::steady_clock::now();
+			size_t index = 1;
+			for (auto it = operations.begin(); it != operations.end(); index++) {
+				bool finished;
+				if (fds[index].revents != 0)
+					finished = advance(*it, results);
+				else if (now >= it->deadline) {
+					fail(*it, results);
+					finished = true;
+				} else if (now >= it->attempt_deadline) {
+					finished = !retry(*it);
+					if (finished)
+						fail(*it, results);
+				} else
+					finished = false;
+
+				if (finished) {
+					close(it->fd);
+					busy_trackers.erase(it->tracker);
+					it = operations.erase(it);
+				} else
+					it++;
+			}
+
+			if (!results.empty() || !sent.empty()) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_results.insert(_results.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+				_sent.insert(_sent.end(), std::make_move_iterator(sent.begin()), std::make_move_iterator(sent.end()));
+				loop::notify();
+			}
+		}
+
+		for (operation &op : operations)
+			close(op.fd);
+	}
+
+	void start() {
+		_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_wake_fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to create the scrape engine event");
+
+		_running = true;
+		_thread = std::thread(run);
+		resolver_thread = std::thread(run_resolver);
+	}
+
+	void stop() {
+		if (!_thread.joinable())
+			return;
+
+		_running = false;
+		uint64_t value = 1;
+		[[maybe_unused]] ssize_t result = write(_wake_fd, &value, sizeof(value));
+		_thread.join();
+
+		{
+			std::lock_guard<std::mutex> lock(resolver_mutex);
+		}
+		resolver_condition.notify_all();
+		resolver_thread.join(); // Waits for a lookup that is still running
+	}
+
+	void request(const std::string &tracker, const lt::sha1_hash &info_hash) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests[tracker].push_back(info_hash);
+	}
+
+	void flush() {
+		uint64_t value = 1;
+		[[maybe_unused]] ssize_t result = write(_wake_fd, &value, sizeof(value));
+	}
+
+	void pop_results(std::vector<result> &results) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		results.insert(results.end(), std::make_move_iterator(_results.begin()), std::make_move_iterator(_results.end()));
+		_results.clear();
+	}
+
+	void pop_sent(std::vector<sent_request> &requests) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		requests.insert(requests.end(), std::make_move_iterator(_sent.begin()), std::make_move_iterator(_sent.end()));
+		_sent.clear();
+	}
+
+	std::thread _thread;
+	std::atomic<bool> _running = false;
+	int _wake_fd = -1;
+	std::mutex _mutex;
+	std::unordered_map<std::string, std::vector<lt::sha1_hash>> _requests;
+	std::vector<result> _results;
+	std::vector<sent_request> _sent;
+}
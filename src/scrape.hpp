@@ -0,0 +1,54 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <libtorrent/sha1_hash.hpp>
+
+// Scrapes HTTP and UDP trackers directly, batching every info-hash queued for the same tracker into as few requests as the protocol allows
+namespace scrape {
+	struct result {
+		lt::sha1_hash info_hash;
+		std::string tracker;
+		bool success;
+		int32_t complete; // Seeders, or -1 if unknown
+		int32_t incomplete; // Leechers, or -1 if unknown
+		int32_t downloaded; // Completed downloads, or -1 if unknown
+		double latency; // Seconds from sending the request to the reply, or -1 if the tracker could not be reached
+	};
+
+	// A queued scrape that has left the queue and been sent to its tracker
+	struct sent_request {
+		lt::sha1_hash info_hash;
+		std::string tracker;
+	};
+
+	// Returns true if the announce URL belongs to a tracker that can be scraped
+	bool is_scrapable(const std::string &tracker);
+
+	void start();
+
+	void stop();
+
+	// Queues a scrape of the torrent. Nothing is sent until the queue is flushed, so that torrents of the same tracker end up in the same request.
+	void request(const std::string &tracker, const lt::sha1_hash &info_hash);
+
+	void flush();
+
+	// Moves finished scrapes into results. The main loop is notified whenever new results arrive.
+	void pop_results(std::vector<result> &results);
+
+	// Moves scrapes that have been sent since the last call into requests. Requests can wait in the queue behind earlier batches of their tracker, so their latency only starts counting from here.
+	void pop_sent(std::vector<sent_request> &requests);
+
+	extern std::thread _thread;
+	extern std::atomic<bool> _running;
+	extern int _wake_fd;
+	extern std::mutex _mutex;
+	extern std::unordered_map<std::string, std::vector<lt::sha1_hash>> _requests;
+	extern std::vector<result> _results;
+	extern std::vector<sent_request> _sent;
+}
@@ -1,70 +1,652 @@
 #include <stats.hpp>
 #include <pch.hpp>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <util.hpp>
+#include <logger.hpp>
+#include <loop.hpp>
 
+// Both the snapshot and the journal are a magic header followed by records in native byte order:
+//   set:    u8 op = 1, u16 name length, name, u16 payload length, payload
+//   remove: u8 op = 2, u16 name length, name
+//   link:   u8 op = 3, u16 file length, file, u16 name length, name
+//   unlink: u8 op = 4, u16 file length, file
+// The payload is length-prefixed so that fields can be appended without breaking older files.
 namespace stats {
-	void try_load() {
-		if (std::filesystem::exists("stats.txt")) {
-			std::cout << "Recovering torrent statistics from previous session." << std::endl;
+	static constexpr char snapshot_magic[8] = {'B', 'T', 'U', 'P', 'S', 'N', 'P', '1'};
+	static constexpr char journal_magic[8] = {'B', 'T', 'U', 'P', 'J', 'N', 'L', '1'};
+	static constexpr uint8_t op_set = 1;
+	static constexpr uint8_t op_remove = 2;
+	static constexpr uint8_t op_link = 3;
+	static constexpr uint8_t op_unlink = 4;
+
+	static const std::filesystem::path snapshot_path = "stats.bin";
+	static const std::filesystem::path journal_path = "stats.journal";
+	static const std::filesystem::path old_journal_path = "stats.journal.old";
+	static const std::filesystem::path legacy_path = "stats.txt";
+
+	template<typename T>
+	static void append_value(std::string &buffer, T value) {
+		buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	static bool read_value(const char *&ptr, const char *end, T &value) {
+		if (end - ptr < static_cast<ptrdiff_t>(sizeof(T)))
+			return false;
+		std::memcpy(&value, ptr, sizeof(T));
+		ptr += sizeof(T);
+		return true;
+	}
+
+	static void encode_payload(std::string &buffer, const torrent &torrent) {
+		append_value<uint64_t>(buffer, torrent.last_recounting_time);
+		append_value<uint32_t>(buffer, torrent.number_of_seeders);
+		append_value<uint32_t>(buffer, torrent.number_of_leechers);
+		append_value<uint32_t>(buffer, torrent.number_of_downloads);
+		append_value<uint64_t>(buffer, torrent.data_size);
+		append_value<double>(buffer, torrent.upload_rate);
+		append_value<uint64_t>(buffer, torrent.seeding_time);
+		append_value<uint64_t>(buffer, torrent.recount_interval);
+	}
+
+	// Fields missing from payloads written by older versions keep their defaults
+	static void decode_payload(const char *ptr, const char *end, torrent &torrent) {
+		torrent = {0, std::numeric_limits<uint32_t>::max()};
+		if (!read_value(ptr, end, torrent.last_recounting_time))
+			return;
+		if (!read_value(ptr, end, torrent.number_of_seeders))
+			return;
+		if (!read_value(ptr, end, torrent.number_of_leechers) || !read_value(ptr, end, torrent.number_of_downloads))
+			return;
+		if (!read_value(ptr, end, torrent.data_size))
+			return;
+		if (!read_value(ptr, end, torrent.upload_rate) || !read_value(ptr, end, torrent.seeding_time))
+			return;
+		if (!read_value(ptr, end, torrent.recount_interval))
+			return;
+	}
+
+	static void encode_set(std::string &buffer, const std::string &name, const torrent &torrent) {
+		append_value<uint8_t>(buffer, op_set);
+		append_value<uint16_t>(buffer, static_cast<uint16_t>(name.size()));
+		buffer += name;
+
+		size_t length_offset = buffer.size();
+		append_value<uint16_t>(buffer, 0);
+		encode_payload(buffer, torrent);
+
+		uint16_t payload_length = static_cast<uint16_t>(buffer.size() - length_offset - sizeof(uint16_t));
+		std::memcpy(buffer.data() + length_offset, &payload_length, sizeof(uint16_t));
+	}
+
+	static void encode_remove(std::string &buffer, const std::string &name) {
+		append_value<uint8_t>(buffer, op_remove);
+		append_value<uint16_t>(buffer, static_cast<uint16_t>(name.size()));
+		buffer += name;
+	}
+
+	static void encode_link(std::string &buffer, const std::string &file, const std::string &name) {
+		append_value<uint8_t>(buffer, op_link);
+		append_value<uint16_t>(buffer, static_cast<uint16_t>(file.size()));
+		buffer += file;
+		append_value<uint16_t>(buffer, static_cast<uint16_t>(name.size()));
+		buffer += name;
+	}
+
+	static void encode_unlink(std::string &buffer, const std::string &file) {
+		append_value<uint8_t>(buffer, op_unlink);
+		append_value<uint16_t>(buffer, static_cast<uint16_t>(file.size()));
+		buffer += file;
+	}
+
+	// Links or unlinks a file without journaling it. Returns false if nothing changed.
+	static bool store_link(const std::string &file, const std::string &name) {
+		auto it = _names_by_file.find(file);
+		if (it != _names_by_file.end()) {
+			if (it->second == name)
+				return false;
+
+			std::vector<std::string> &files = _files_by_name[it->second];
+			std::erase(files, file);
+			if (files.empty())
+				_files_by_name.erase(it->second);
+		}
+
+		_names_by_file[file] = name;
+		_files_by_name[name].push_back(file);
+		return true;
+	}
+
+	static bool erase_link(const std::string &file) {
+		auto it = _names_by_file.find(file);
+		if (it == _names_by_file.end())
+			return false;
+
+		std::vector<std::string> &files = _files_by_name[it->second];
+		std::erase(files, file);
+		if (files.empty())
+			_files_by_name.erase(it->second);
+		_names_by_file.erase(it);
+		return true;
+	}
+
+	// Adds or overwrites an entry without journaling it
+	static torrent_id store(const std::string &name, const torrent &torrent) {
+		auto it = _ids.find(name);
+		if (it != _ids.end()) {
+			_torrents[it->second] = torrent;
+			return it->second;
+		}
+
+		torrent_id id;
+		if (!_free_ids.empty()) {
+			id = _free_ids.back();
+			_free_ids.pop_back();
+			_names[id] = name;
+			_torrents[id] = torrent;
+		} else {
+			id = static_cast<torrent_id>(_names.size());
+			_names.push_back(name);
+			_torrents.push_back(torrent);
+		}
+
+		// Names never move in a deque, so the index can refer to them instead of holding copies
+		_ids.emplace(_names[id], id);
+		return id;
+	}
+
+	// Removes an entry without journaling it. Returns false if there is none.
+	static bool erase(const std::string &name) {
+		auto it = _ids.find(name);
+		if (it == _ids.end())
+			return false;
 
-			std::ifstream stats_file("stats.txt");
-			std::string line;
+		// The files of a removed torrent are forgotten with it
+		auto files = _files_by_name.find(name);
+		if (files != _files_by_name.end()) {
+			for (const std::string &file : files->second)
+				_names_by_file.erase(file);
+			_files_by_name.erase(files);
+		}
+
+		torrent_id id = it->second;
+		_ids.erase(it);
+		_names[id].clear();
+		_free_ids.push_back(id);
+		return true;
+	}
+
+	// Applies records to the table and returns the length of the valid part of the data. A torn record at the end is ignored. If apply is false, the records are only validated.
+	static size_t apply_records(const char *begin, const char *end, bool apply) {
+		const char *ptr = begin;
+		while (ptr < end) {
+			const char *record = ptr;
+
+			uint8_t op;
+			uint16_t name_length;
+			if (!read_value(ptr, end, op) || !read_value(ptr, end, name_length) || end - ptr < name_length)
+				return record - begin;
+			std::string name(ptr, name_length);
+			ptr += name_length;
+
+			if (op == op_set) {
+				uint16_t payload_length;
+				if (!read_value(ptr, end, payload_length) || end - ptr < payload_length)
+					return record - begin;
+				if (apply) {
+					torrent torrent;
+					decode_payload(ptr, ptr + payload_length, torrent);
+					store(name, torrent);
+				}
+				ptr += payload_length;
+			} else if (op == op_remove) {
+				if (apply)
+					erase(name);
+			} else if (op == op_link) {
+				uint16_t linked_length;
+				if (!read_value(ptr, end, linked_length) || end - ptr < linked_length)
+					return record - begin;
+				if (apply)
+					store_link(name, std::string(ptr, linked_length));
+				ptr += linked_length;
+			} else if (op == op_unlink) {
+				if (apply)
+					erase_link(name);
+			} else
+				return record - begin;
+		}
+		return ptr - begin;
+	}
+
+	// Replays a snapshot or a journal through mmap. Returns the length of its valid part including the header, or 0 if the file is missing or invalid.
+	static size_t replay(const std::filesystem::path &path, const char (&magic)[8], bool apply = true) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return 0;
 
-			std::getline(stats_file, line); // Skip header
-			while (!stats_file.eof()) {
-				std::getline(stats_file, line);
-				if (line.empty())
+		struct stat file_stat;
+		size_t valid_length = 0;
+		if (fstat(fd, &file_stat) == 0 && file_stat.st_size >= static_cast<off_t>(sizeof(magic))) {
+			size_t length = file_stat.st_size;
+			void *data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				const char *begin = static_cast<const char *>(data);
+				if (std::memcmp(begin, magic, sizeof(magic)) == 0)
+					valid_length = sizeof(magic) + apply_records(begin + sizeof(magic), begin + length, apply);
+				else
+					logger::warning() << "File \"" << path.string() << "\" is not a valid statistics file. Ignoring it.";
+				munmap(data, length);
+			}
+		}
+
+		::close(fd);
+		return valid_length;
+	}
+
+	static void write_all(int fd, const std::string &buffer) {
+		const char *ptr = buffer.data();
+		size_t remaining = buffer.size();
+		while (remaining != 0) {
+			ssize_t written = write(fd, ptr, remaining);
+			if (written < 0) {
+				if (errno == EINTR)
 					continue;
+				throw std::system_error(errno, std::generic_category(), "Unable to write statistics");
+			}
+			ptr += written;
+			remaining -= written;
+		}
+	}
+
+	static void write_snapshot(const std::deque<std::string> &names, const std::vector<torrent> &torrents, const std::unordered_map<std::string, std::string> &names_by_file) {
+		std::string buffer(snapshot_magic, sizeof(snapshot_magic));
+		for (size_t id = 0; id < names.size(); id++) {
+			if (!names[id].empty())
+				encode_set(buffer, names[id], torrents[id]);
+		}
+		for (const auto &[file, name] : names_by_file)
+			encode_link(buffer, file, name);
+
+		// Write to a temporary file first, so that a crash never leaves a partial snapshot behind
+		std::filesystem::path tmp_path = snapshot_path.string() + ".tmp";
+		int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to create \"" + tmp_path.string() + "\"");
+		try {
+			write_all(fd, buffer);
+			if (fsync(fd) != 0)
+				throw std::system_error(errno, std::generic_category(), "Unable to write statistics");
+		} catch (std::exception &) {
+			// A partial snapshot would only take up space the next attempt needs
+			::close(fd);
+			std::error_code error;
+			std::filesystem::remove(tmp_path, error);
+			throw;
+		}
+		::close(fd);
+
+		std::filesystem::rename(tmp_path, snapshot_path);
+		_snapshot_size = buffer.size();
+	}
+
+	static void open_journal(size_t valid_length) {
+		_journal_fd = open(journal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (_journal_fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to open \"" + journal_path.string() + "\"");
+
+		// Drop a torn record left behind by a crash, so that new records are not appended after garbage
+		if (ftruncate(_journal_fd, valid_length) != 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to truncate \"" + journal_path.string() + "\"");
+
+		_journal_size = valid_length;
+		if (_journal_size == 0) {
+			write_all(_journal_fd, std::string(journal_magic, sizeof(journal_magic)));
+			_journal_size = sizeof(journal_magic);
+		}
+		_journal_failed = false;
+	}
+
+	// Changes that cannot be journaled are kept in memory and written by the next snapshot, so that a full disk does not stop the process
+	static void try_open_journal(size_t valid_length) {
+		try {
+			open_journal(valid_length);
+		} catch (std::exception &e) {
+			logger::warning() << "Unable to open the statistics journal: " << e.what() << ". Changes are kept in memory until the next compaction.";
+			if (_journal_fd >= 0)
+				::close(_journal_fd);
+			_journal_fd = -1;
+			_journal_failed = true;
+		}
+	}
+
+	// Appends the records of the journal to the journal a failed compaction left behind, so that the next snapshot replaces both
+	static void merge_journals() {
+		size_t old_length = replay(old_journal_path, journal_magic, false);
+		size_t length = replay(journal_path, journal_magic, false);
+
+		std::string buffer;
+		if (old_length == 0)
+			buffer.assign(journal_magic, sizeof(journal_magic));
+		if (length > sizeof(journal_magic)) {
+			std::ifstream file(journal_path, std::ios::binary);
+			file.seekg(sizeof(journal_magic));
+			std::string records(length - sizeof(journal_magic), '\0');
+			file.read(records.data(), records.size());
+			if (!file)
+				throw std::runtime_error("Unable to read \"" + journal_path.string() + "\".");
+			buffer += records;
+		}
+
+		int fd = open(old_journal_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "Unable to open \"" + old_journal_path.string() + "\"");
+		try {
+			// Records appended after a torn one would be lost on replay
+			if (ftruncate(fd, old_length) != 0 || lseek(fd, 0, SEEK_END) < 0)
+				throw std::system_error(errno, std::generic_category(), "Unable to truncate \"" + old_journal_path.string() + "\"");
+			write_all(fd, buffer);
+			if (fsync(fd) != 0)
+				throw std::system_error(errno, std::generic_category(), "Unable to write statistics");
+		} catch (std::exception &) {
+			::close(fd);
+			throw;
+		}
+		::close(fd);
 
-				std::stringstream ss(line);
-				std::string name;
-				std::string last_recounting_time;
-				std::string number_of_seeders;
-				
-				std::getline(ss, name, '/');
-				std::getline(ss, last_recounting_time, '/');
-				std::getline(ss, number_of_seeders, '/');
+		// Replaying the merged records twice after a crash right here still ends in the same state
+		std::error_code error;
+		std::filesystem::remove(journal_path, error);
+	}
+
+	static bool journal_needs_compaction() {
+		return _journal_failed || (_journal_fd >= 0 && _journal_size >= std::max<uint64_t>(1024 * 1024, _snapshot_size));
+	}
+
+	static void append(const std::string &record) {
+		if (_journal_fd < 0 || _journal_failed)
+			return; // Statistics have not been loaded yet or the journal is broken, so the records will be written by the next snapshot
+
+		try {
+			write_all(_journal_fd, record);
+			_journal_size += record.size();
+		} catch (std::exception &e) {
+			logger::warning() << "Unable to append to the statistics journal: " << e.what() << ". Changes are kept in memory until the next compaction.";
+			_journal_failed = true;
+
+			// Records appended after a torn one would be lost on replay
+			if (ftruncate(_journal_fd, _journal_size) != 0)
+				logger::warning() << "Unable to truncate \"" << journal_path.string() << "\".";
+		}
+	}
+
+	// Imports statistics from the text file used by older versions
+	static void import_legacy() {
+		logger::info() << "Importing torrent statistics from \"" << legacy_path.string() << "\".";
+
+		std::ifstream stats_file(legacy_path);
+		std::string line;
+
+		std::getline(stats_file, line); // Skip header
+		while (!stats_file.eof()) {
+			std::getline(stats_file, line);
+			if (line.empty())
+				continue;
+
+			std::stringstream ss(line);
+			std::string name;
+			std::string last_recounting_time;
+			std::string number_of_seeders;
+			
+			std::getline(ss, name, '/');
+			std::getline(ss, last_recounting_time, '/');
+			std::getline(ss, number_of_seeders, '/');
+
+			store(name, torrent{std::stoull(last_recounting_time), static_cast<uint32_t>(std::stoul(number_of_seeders))});
+		}
+	}
+
+	void try_load() {
+		bool has_journal = std::filesystem::exists(journal_path);
+		bool has_old_journal = std::filesystem::exists(old_journal_path);
+		size_t journal_length = 0;
+		bool legacy_pending = false;
 
-				_stats[name] = torrent{std::stoull(last_recounting_time), static_cast<uint32_t>(std::stoul(number_of_seeders))};
+		if (std::filesystem::exists(snapshot_path) || has_journal || has_old_journal) {
+			logger::info() << "Recovering torrent statistics from previous session.";
+
+			_snapshot_size = replay(snapshot_path, snapshot_magic);
+			replay(old_journal_path, journal_magic);
+			journal_length = replay(journal_path, journal_magic);
+		} else if (std::filesystem::exists(legacy_path)) {
+			import_legacy();
+			try {
+				write_snapshot(_names, _torrents, _names_by_file);
+				std::filesystem::rename(legacy_path, legacy_path.string() + ".imported");
+			} catch (std::exception &e) {
+				logger::warning() << "Unable to write the imported statistics: " << e.what();
+				legacy_pending = true;
 			}
 		}
+
+		// A compaction was interrupted, so fold everything into a fresh snapshot before appending again
+		if (has_old_journal) {
+			try {
+				write_snapshot(_names, _torrents, _names_by_file);
+				std::filesystem::remove(journal_path);
+				std::filesystem::remove(old_journal_path);
+				journal_length = 0;
+			} catch (std::exception &e) {
+				// Both journals stay in place until a compaction succeeds
+				logger::warning() << "Unable to compact statistics: " << e.what();
+			}
+		}
+
+		try_open_journal(journal_length);
+		_journal_failed = _journal_failed || legacy_pending; // The imported statistics are only in memory
+		_last_compaction_time = util::seconds_since_epoch();
 	}
 
 	void try_save() {
-		if (_stats_changed && util::seconds_since_epoch() - _last_save_time > 30) {
-			std::cout << "Saving statistics." << std::endl;
-			
-			std::ofstream stats_file("stats.txt");
-			stats_file << "torrent-name/last-recounting-time/number-of-seeders" << std::endl; // Add the header
-			for (const auto &[name, torrent] : _stats)
-				stats_file << name << '/' << torrent.last_recounting_time << '/' << torrent.number_of_seeders << std::endl;
+		if (_compaction_thread.joinable()) {
+			if (!_compaction_done)
+				return;
+			_compaction_thread.join();
+
+			// Changes since the last snapshot are only in the old journal and in memory, so compact again soon
+			if (_compaction_failed)
+				_journal_failed = true;
+		}
+
+		// Compact once the journal outgrows the snapshot, but not more often than every 30 seconds
+		uint64_t now = util::seconds_since_epoch();
+		if (!journal_needs_compaction() || now - _last_compaction_time <= 30)
+			return;
+
+		// Attempts that fail are retried after the same delay, so that the main loop does not spin on them
+		_last_compaction_time = now;
+
+		logger::debug() << "Compacting statistics.";
+
+		// Records appended from now on go to a new journal, while the old one is kept until the snapshot that covers it is in place
+		bool journal_open = _journal_fd >= 0;
+		if (journal_open)
+			::close(_journal_fd);
+		_journal_fd = -1;
+
+		try {
+			if (std::filesystem::exists(old_journal_path))
+				merge_journals(); // A previous compaction failed and its journal is still needed
+			else if (std::filesystem::exists(journal_path))
+				std::filesystem::rename(journal_path, old_journal_path);
+		} catch (std::exception &e) {
+			logger::warning() << "Unable to compact statistics: " << e.what();
+			if (journal_open) {
+				bool failed = _journal_failed;
+				try_open_journal(_journal_size);
+				_journal_failed = _journal_failed || failed;
+			}
+			return;
+		}
+
+		try_open_journal(0);
+
+		_compaction_done = false;
+		_compaction_failed = false;
+		_compaction_thread = std::thread([names = _names, torrents = _torrents, names_by_file = _names_by_file]() {
+			try {
+				write_snapshot(names, torrents, names_by_file);
+				std::filesystem::remove(old_journal_path);
+			} catch (std::exception &e) {
+				// The old journal stays in place and the next compaction merges the new one into it
+				logger::warning() << "Unable to compact statistics: " << e.what();
+				_compaction_failed = true;
+			}
+			_compaction_done = true;
+			loop::notify(); // Let the main loop join this thread
+		});
+	}
+
+	uint64_t next_save_time() {
+		if (_compaction_thread.joinable() || !journal_needs_compaction())
+			return std::numeric_limits<uint64_t>::max(); // The compaction thread wakes the main loop when it is done
+		return _last_compaction_time + 31;
+	}
 
-			_stats_changed = false;
-			_last_save_time = util::seconds_since_epoch();
+	void close() {
+		if (_compaction_thread.joinable())
+			_compaction_thread.join();
+
+		if (_journal_fd >= 0) {
+			::close(_journal_fd);
+			_journal_fd = -1;
 		}
 	}
 
-	const std::map<std::string, torrent> &get() {
-		return _stats;
+	torrent_id find(const std::string &name) {
+		auto it = _ids.find(name);
+		return it == _ids.end() ? no_id : it->second;
+	}
+
+	bool contains(const std::string &name) {
+		return _ids.contains(name);
+	}
+
+	bool contains(torrent_id id) {
+		return id < _names.size() && !_names[id].empty();
+	}
+
+	const torrent &get(torrent_id id) {
+		return _torrents[id];
+	}
+
+	const std::string &name_of(torrent_id id) {
+		return _names[id];
+	}
+
+	size_t size() {
+		return _ids.size();
 	}
 
-	void set(std::map<std::string, torrent> &&stats) {
-		_stats = std::move(stats);
-		_stats_changed = true;
+	void get_ids(std::vector<torrent_id> &ids) {
+		ids.clear();
+		ids.reserve(_ids.size());
+		for (torrent_id id = 0; id < _names.size(); id++) {
+			if (!_names[id].empty())
+				ids.push_back(id);
+		}
+	}
+
+	torrent_id set(const std::string &name, const torrent &torrent) {
+		torrent_id id = find(name);
+		if (id != no_id && _torrents[id] == torrent)
+			return id;
+
+		id = store(name, torrent);
+
+		std::string record;
+		encode_set(record, name, torrent);
+		append(record);
+		return id;
 	}
 
-	void set(const std::string &name, uint64_t last_recounting_time, uint32_t number_of_seeders) {
-		_stats[name] = torrent{last_recounting_time, number_of_seeders};
-		_stats_changed = true;
+	void set(torrent_id id, const torrent &torrent) {
+		if (_torrents[id] == torrent)
+			return;
+
+		_torrents[id] = torrent;
+
+		std::string record;
+		encode_set(record, _names[id], torrent);
+		append(record);
 	}
 
 	void remove(const std::string &name) {
-		_stats.erase(name);
-		_stats_changed = true;
+		if (!erase(name))
+			return;
+
+		std::string record;
+		encode_remove(record, name);
+		append(record);
+	}
+
+	void link(const std::string &file, const std::string &name) {
+		if (!store_link(file, name))
+			return;
+
+		std::string record;
+		encode_link(record, file, name);
+		append(record);
+	}
+
+	void unlink(const std::string &file) {
+		if (!erase_link(file))
+			return;
+
+		std::string record;
+		encode_unlink(record, file);
+		append(record);
+	}
+
+	const std::string *name_of_file(const std::string &file) {
+		auto it = _names_by_file.find(file);
+		return it == _names_by_file.end() ? nullptr : &it->second;
+	}
+
+	const std::vector<std::string> &files_of(const std::string &name) {
+		static const std::vector<std::string> none;
+		auto it = _files_by_name.find(name);
+		return it == _files_by_name.end() ? none : it->second;
+	}
+
+	const std::unordered_map<std::string, std::string> &files() {
+		return _names_by_file;
+	}
+
+	void clear() {
+		_names.clear();
+		_torrents.clear();
+		_free_ids.clear();
+		_ids.clear();
+		_names_by_file.clear();
+		_files_by_name.clear();
 	}
 
-    std::map<std::string, torrent> _stats;
-	bool _stats_changed = false;
-	uint64_t _last_save_time = 0;
+	std::deque<std::string> _names;
+	std::vector<torrent> _torrents;
+	std::vector<torrent_id> _free_ids;
+	std::unordered_map<std::string_view, torrent_id> _ids;
+	std::unordered_map<std::string, std::string> _names_by_file;
+	std::unordered_map<std::string, std::vector<std::string>> _files_by_name;
+	int _journal_fd = -1;
+	uint64_t _journal_size = 0;
+	bool _journal_failed = false;
+	uint64_t _snapshot_size = 0;
+	uint64_t _last_compaction_time = 0;
+	std::thread _compaction_thread;
+	std::atomic<bool> _compaction_done = true;
+	std::atomic<bool> _compaction_failed = false;
 }
@@ -1,26 +1,93 @@
-#include <map>
 #include <cstdint>
+#include <deque>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <atomic>
 
+// Torrents are registered under their key, which is the hex info-hash of the torrent. Names of .torrent files are only an index into them.
 namespace stats {
+	// Stays the same for as long as the torrent is registered. Ids of removed torrents are reused.
+	using torrent_id = uint32_t;
+
+	inline constexpr torrent_id no_id = std::numeric_limits<torrent_id>::max();
+
 	struct torrent {
 		uint64_t last_recounting_time;
 		uint32_t number_of_seeders;
+		uint32_t number_of_leechers = 0;
+		uint32_t number_of_downloads = 0; // Completed downloads the tracker has seen
+		uint64_t data_size = 0; // Total size of the torrent's data, 0 until it has been loaded to be seeded
+		double upload_rate = 0; // Exponentially decayed payload upload in bytes per second, sampled while seeding
+		uint64_t seeding_time = 0; // Seconds over which the upload rate has been sampled
+		uint64_t recount_interval = 0; // Seconds between the last recount and the next one, 0 for the default interval
+
+		bool operator==(const torrent &other) const = default;
 	};
 
 	void try_load();
 
+	// Appended changes are already on disk. This only compacts the journal into a new snapshot in the background once it grows too large.
 	void try_save();
 
-	const std::map<std::string, torrent> &get();
+	// Returns the time (in seconds since epoch) at which try_save has work to do
+	uint64_t next_save_time();
+
+	// Waits for a running compaction to finish and closes the journal
+	void close();
+
+	// Returns no_id if the torrent is not registered
+	torrent_id find(const std::string &name);
+
+	bool contains(const std::string &name);
+
+	bool contains(torrent_id id);
+
+	const torrent &get(torrent_id id);
+
+	const std::string &name_of(torrent_id id);
 
-	void set(std::map<std::string, torrent> &&stats);
+	size_t size();
 
-	void set(const std::string &name, uint64_t last_recounting_time, uint32_t number_of_seeders);
+	void get_ids(std::vector<torrent_id> &ids);
+
+	// Registers the torrent if it is new and returns its id
+	torrent_id set(const std::string &name, const torrent &torrent);
+
+	void set(torrent_id id, const torrent &torrent);
 
 	void remove(const std::string &name);
 
-    extern std::map<std::string, torrent> _stats;
-	extern bool _stats_changed;
-	extern uint64_t _last_save_time;
+	// Records that the .torrent file describes the torrent. Duplicate files of a torrent are linked to the same name. Removing a torrent unlinks its files.
+	void link(const std::string &file, const std::string &name);
+
+	void unlink(const std::string &file);
+
+	// Returns nullptr if the file has not been linked to a torrent
+	const std::string *name_of_file(const std::string &file);
+
+	const std::vector<std::string> &files_of(const std::string &name);
+
+	const std::unordered_map<std::string, std::string> &files();
+
+	// Forgets all statistics without touching the files, so that they can be loaded again
+	void clear();
+
+	extern std::deque<std::string> _names; // Indexed by id, empty for ids that are free
+	extern std::vector<torrent> _torrents; // Indexed by id
+	extern std::vector<torrent_id> _free_ids;
+	extern std::unordered_map<std::string_view, torrent_id> _ids; // Views into _names
+	extern std::unordered_map<std::string, std::string> _names_by_file;
+	extern std::unordered_map<std::string, std::vector<std::string>> _files_by_name;
+	extern int _journal_fd;
+	extern uint64_t _journal_size;
+	extern bool _journal_failed; // Records are no longer appended, because writing one failed
+	extern uint64_t _snapshot_size;
+	extern uint64_t _last_compaction_time;
+	extern std::thread _compaction_thread;
+	extern std::atomic<bool> _compaction_done;
+	extern std::atomic<bool> _compaction_failed;
 }
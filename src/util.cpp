@@ -7,4 +7,16 @@ uint64_t seconds_since_epoch() {
 	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
+std::string to_hex(const lt::sha1_hash &hash) {
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	hex.reserve(hash.size() * 2);
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(hash.data());
+	for (size_t i = 0; i < hash.size(); i++) {
+		hex += digits[bytes[i] >> 4];
+		hex += digits[bytes[i] & 0xF];
+	}
+	return hex;
+}
+
 }
@@ -1,7 +1,13 @@
 #include <cstdint>
+#include <string>
+
+#include <libtorrent/sha1_hash.hpp>
 
 namespace util {
 
 uint64_t seconds_since_epoch();
 
+// Returns the lowercase hex form of the hash, which torrents are keyed by
+std::string to_hex(const lt::sha1_hash &hash);
+
 }
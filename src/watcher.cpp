@@ -0,0 +1,70 @@
+#include <watcher.hpp>
+#include <pch.hpp>
+
+#include <sys/inotify.h>
+
+namespace watcher {
+	static void close_fd() {
+		if (_fd >= 0)
+			close(_fd);
+		_fd = -1;
+		_wd = -1;
+	}
+
+	bool init(const std::filesystem::path &dir) {
+		close_fd();
+
+		_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (_fd < 0)
+			return false;
+
+		_wd = inotify_add_watch(
+			_fd,
+			dir.c_str(),
+			IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR
+		);
+		if (_wd < 0) {
+			close_fd();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool poll(std::vector<event> &events) {
+		if (_fd < 0)
+			return false;
+
+		alignas(inotify_event) char buffer[64 * 1024];
+		while (true) {
+			ssize_t length = read(_fd, buffer, sizeof(buffer));
+			if (length < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN)
+					return true;
+				close_fd();
+				return false;
+			}
+
+			for (char *ptr = buffer; ptr < buffer + length;) {
+				auto *item = reinterpret_cast<inotify_event *>(ptr);
+				ptr += sizeof(inotify_event) + item->len;
+
+				// The queue has overflowed or the directory itself is gone, so the watch can no longer be trusted
+				if (item->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+					close_fd();
+					return false;
+				}
+
+				if ((item->mask & IN_ISDIR) || item->len == 0)
+					continue;
+
+				events.push_back(event{item->name, (item->mask & (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO)) != 0});
+			}
+		}
+	}
+
+	int _fd = -1;
+	int _wd = -1;
+}
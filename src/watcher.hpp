@@ -0,0 +1,19 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace watcher {
+	struct event {
+		std::string name;
+		bool created; // Otherwise the file was deleted or moved out of the directory
+	};
+
+	// (Re)starts watching the directory. Returns false if inotify is not available.
+	bool init(const std::filesystem::path &dir);
+
+	// Collects pending events without blocking. Returns false if events might have been lost and the directory has to be rescanned.
+	bool poll(std::vector<event> &events);
+
+	extern int _fd;
+	extern int _wd;
+}